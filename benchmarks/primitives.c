@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "fen.h"
+#include "packed_position.h"
+#include "book.h"
+#include "tablebase.h"
+#include "transposition_table.h"
+#include "attack_fill.h"
+
+#define NUM_SAMPLES 25
+#define NUM_OCCUPANCIES 4096
+#define MAX_POSITIONS 1024
+#define TABLEBASE_DIRECTORY "benchmarks/bin"
+#define LARGE_TABLE_SIZE (256ULL * 1024 * 1024 / sizeof(Entry))
+
+typedef struct
+{
+    int square;
+    BitBoard occupied_squares;
+} SliderQuery;
+
+/**
+ * Runs a benchmark for one sample and returns the number of operations it performed.
+ **/
+typedef U64 (*Benchmark)(void);
+
+static SliderQuery slider_queries[NUM_OCCUPANCIES];
+static ChessBoard positions[MAX_POSITIONS];
+static char position_fens[MAX_POSITIONS][FEN_MAX_LENGTH];
+static PackedPosition packed_positions[MAX_POSITIONS];
+static MoveList position_moves[MAX_POSITIONS];
+static int num_positions;
+static ChessBoard endgame_positions[MAX_POSITIONS];
+static TranspositionTable *large_table;
+static U64 table_keys[NUM_OCCUPANCIES];
+
+// Results are accumulated into sink so the compiler cannot remove the benchmarked calls
+static volatile U64 sink;
+
+/**
+ * Returns a pseudo random number using xorshift64.
+ **/
+static U64 random_number(void)
+{
+    static U64 state = 0x9e3779b97f4a7c15;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    return state;
+}
+
+/**
+ * Returns the time in nanoseconds from an arbitrary fixed point.
+ **/
+static double time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * Loads the positions of the given EPD file into the corpus.
+ **/
+static void load_positions(char *filename)
+{
+    FILE *file_ptr = fopen(filename, "r");
+    if (file_ptr == NULL)
+    {
+        printf("Could not open %s.\n", filename);
+        exit(1);
+    }
+
+    char line[1000];
+    while (num_positions < MAX_POSITIONS && fgets(line, sizeof(line), file_ptr) != NULL)
+    {
+        line[strcspn(line, ";\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+
+        chessboard_init(&positions[num_positions], line);
+        fen_write(&positions[num_positions], position_fens[num_positions]);
+        packed_encode(&positions[num_positions], &packed_positions[num_positions]);
+        chessboard_generate_moves(&positions[num_positions], &position_moves[num_positions]);
+        num_positions++;
+    }
+
+    fclose(file_ptr);
+}
+
+/**
+ * The strtok based FEN parser chessboard_init used before fen_parse, kept as
+ * the baseline fen_parse is measured against.
+ **/
+static void strtok_fen_parse(ChessBoard *board, char *fen_str)
+{
+    memset(board, 0, sizeof(ChessBoard));
+
+    char fen_cpy[100];
+    strncpy(fen_cpy, fen_str, sizeof(fen_cpy) - 1);
+    fen_cpy[sizeof(fen_cpy) - 1] = '\0';
+
+    char *token = strtok(fen_cpy, " ");
+    for (int i = 0, rank = RANK_8, file = FILE_A; token[i] != '\0'; i++)
+    {
+        if (token[i] == '/')
+        {
+            rank--;
+            file = FILE_A;
+        }
+        else if (isdigit(token[i]))
+        {
+            file += token[i] - '0';
+        }
+        else
+        {
+            Piece piece_type = fen_to_piece(token[i]);
+            Piece piece_color = PieceColor(piece_type);
+
+            board->pieces[piece_type] |= FileRankToSquare(file, rank);
+            board->pieces[piece_color] |= FileRankToSquare(file, rank);
+            file++;
+        }
+    }
+
+    token = strtok(NULL, " ");
+    board->current_color = (token[0] == 'w') ? WHITE : BLACK;
+
+    token = strtok(NULL, " ");
+    for (int i = 0; token[0] != '-' && token[i] != '\0'; i++)
+    {
+        switch (token[i])
+        {
+            case 'K':
+                board->castle_permission |= WHITE_KING_SIDE;
+                break;
+            case 'Q':
+                board->castle_permission |= WHITE_QUEEN_SIDE;
+                break;
+            case 'k':
+                board->castle_permission |= BLACK_KING_SIDE;
+                break;
+            case 'q':
+                board->castle_permission |= BLACK_QUEEN_SIDE;
+                break;
+        }
+    }
+
+    token = strtok(NULL, " ");
+    if (token[0] != '-')
+        board->en_passent |= FileRankToSquare(token[0] - 'a', token[1] - '1');
+
+    token = strtok(NULL, " ");
+    board->num_half_moves = atoi(token);
+    token = strtok(NULL, " ");
+    board->num_full_moves = atoi(token);
+
+    board->position_key = chessboard_hash(board);
+    board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
+    board->empty_squares = ~board->occupied_squares;
+}
+
+/**
+ * Fills the slider queries with random squares and occupancies of varying density.
+ **/
+static void generate_slider_queries(void)
+{
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+    {
+        slider_queries[i].square = random_number() % 64;
+
+        switch (i % 3)
+        {
+            case 0:
+                slider_queries[i].occupied_squares = random_number() & random_number() & random_number();
+                break;
+            case 1:
+                slider_queries[i].occupied_squares = random_number() & random_number();
+                break;
+            default:
+                slider_queries[i].occupied_squares = random_number();
+                break;
+        }
+    }
+}
+
+/**
+ * Generates the KRvK table and fills the endgame corpus with random legal
+ * KRvK positions.
+ **/
+static void generate_endgame_positions(void)
+{
+    if (!tablebase_generate(TABLEBASE_DIRECTORY, "KRvK", 1))
+    {
+        printf("Could not generate KRvK in %s.\n", TABLEBASE_DIRECTORY);
+        exit(1);
+    }
+
+    for (int i = 0; i < MAX_POSITIONS;)
+    {
+        ChessBoard *board = &endgame_positions[i];
+        int white_king = random_number() % 64, black_king = random_number() % 64, rook = random_number() % 64;
+        if (white_king == black_king || rook == white_king || rook == black_king
+            || (MASK_KING_ATTACKS[white_king] & (1ULL << black_king)))
+            continue;
+
+        char fen[FEN_MAX_LENGTH], *current = fen;
+        for (int rank = 7; rank >= 0; rank--)
+        {
+            for (int file = 0; file < 8; file++)
+            {
+                int square = rank * 8 + file;
+                *current++ = (square == white_king) ? 'K' : (square == black_king) ? 'k' : (square == rook) ? 'R' : '1';
+            }
+            *current++ = (rank > 0) ? '/' : ' ';
+        }
+        strcpy(current, (random_number() & 1) ? "w - - 0 1" : "b - - 0 1");
+        chessboard_init(board, fen);
+
+        // The side that just moved cannot be left in check
+        board->current_color ^= 1;
+        bool illegal = chessboard_squared_attacked(board, (board->current_color == WHITE) ? white_king : black_king);
+        board->current_color ^= 1;
+        if (!illegal)
+            i++;
+    }
+}
+
+/**
+ * Allocates the large transposition table, fills it with random keys and then
+ * stores a chain of keys whose entries hold the index of the next key, so each
+ * probe of the chain depends on the one before it.
+ **/
+static void generate_large_table(void)
+{
+    large_table = table_init(LARGE_TABLE_SIZE);
+    if (large_table == NULL)
+    {
+        printf("Could not allocate the transposition table.\n");
+        exit(1);
+    }
+
+    for (U64 i = 0; i < LARGE_TABLE_SIZE; i++)
+        table_store(large_table, random_number(), NULL_MOVE, 0, 1, BOUND_EXACT);
+
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+        table_keys[i] = random_number();
+
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+        table_store(large_table, table_keys[i], NULL_MOVE, (i + 1) % NUM_OCCUPANCIES, 1, BOUND_EXACT);
+}
+
+static U64 benchmark_rook_attacks(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+        result ^= lookup_rook_attacks(slider_queries[i].square, slider_queries[i].occupied_squares);
+
+    sink ^= result;
+    return NUM_OCCUPANCIES;
+}
+
+static U64 benchmark_bishop_attacks(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+        result ^= lookup_bishop_attacks(slider_queries[i].square, slider_queries[i].occupied_squares);
+
+    sink ^= result;
+    return NUM_OCCUPANCIES;
+}
+
+static U64 benchmark_queen_attacks(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+        result ^= lookup_queen_attacks(slider_queries[i].square, slider_queries[i].occupied_squares);
+
+    sink ^= result;
+    return NUM_OCCUPANCIES;
+}
+
+static U64 benchmark_generate_moves(void)
+{
+    MoveList list;
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        chessboard_generate_moves(&positions[i], &list);
+        result += list.size;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_make_undo_move(void)
+{
+    U64 num_operations = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        for (int j = 0; j < position_moves[i].size; j++)
+        {
+            if (chessboard_make_move(&positions[i], position_moves[i].moves[j]))
+                chessboard_undo_move(&positions[i]);
+        }
+
+        num_operations += position_moves[i].size;
+    }
+
+    sink ^= positions[0].position_key;
+    return num_operations;
+}
+
+static U64 benchmark_squared_attacked(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        for (int square = A1; square <= H8; square++)
+            result += chessboard_squared_attacked(&positions[i], square);
+    }
+
+    sink ^= result;
+    return num_positions * 64;
+}
+
+static U64 benchmark_attack_fill_side(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+        result ^= attack_fill_side(&positions[i], positions[i].current_color ^ 1, positions[i].occupied_squares);
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_attack_info(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        AttackInfo attacks;
+        chessboard_attack_info(&positions[i], &attacks);
+        result ^= attacks.king_danger ^ attacks.pinned ^ attacks.check_mask;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_hash(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+        result ^= chessboard_hash(&positions[i]);
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_strtok_fen_parse(void)
+{
+    static ChessBoard board;
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        strtok_fen_parse(&board, position_fens[i]);
+        result ^= board.position_key;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_fen_parse(void)
+{
+    static ChessBoard board;
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        fen_parse(&board, position_fens[i], NULL);
+        result ^= board.position_key;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_fen_write(void)
+{
+    char fen[FEN_MAX_LENGTH];
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+        result += fen_write(&positions[i], fen);
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_packed_encode(void)
+{
+    PackedPosition packed;
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        packed_encode(&positions[i], &packed);
+        result ^= packed.occupancy;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_packed_decode(void)
+{
+    static ChessBoard board;
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+    {
+        packed_decode(&packed_positions[i], &board);
+        result ^= board.position_key;
+    }
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_book_key(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < num_positions; i++)
+        result ^= book_key(&positions[i]);
+
+    sink ^= result;
+    return num_positions;
+}
+
+static U64 benchmark_tablebase_probe_wdl(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < MAX_POSITIONS; i++)
+    {
+        TablebaseWdl wdl;
+        tablebase_probe_wdl(&endgame_positions[i], &wdl);
+        result += wdl;
+    }
+
+    sink ^= result;
+    return MAX_POSITIONS;
+}
+
+static U64 benchmark_tablebase_probe_dtm(void)
+{
+    U64 result = 0;
+    for (int i = 0; i < MAX_POSITIONS; i++)
+    {
+        TablebaseWdl wdl;
+        int plies;
+        tablebase_probe_dtm(&endgame_positions[i], &wdl, &plies);
+        result += plies;
+    }
+
+    sink ^= result;
+    return MAX_POSITIONS;
+}
+
+static U64 benchmark_table_probe(void)
+{
+    int index = 0;
+    for (int i = 0; i < NUM_OCCUPANCIES; i++)
+    {
+        EntryData data;
+        index = table_probe(large_table, table_keys[index], &data) ? data.score : (index + 1) % NUM_OCCUPANCIES;
+    }
+
+    sink ^= index;
+    return NUM_OCCUPANCIES;
+}
+
+static U64 benchmark_table_clear(void)
+{
+    table_clear(large_table, sysconf(_SC_NPROCESSORS_ONLN));
+    return 1;
+}
+
+/**
+ * Times the benchmark over several samples and prints the mean, standard
+ * deviation and minimum time per operation as a CSV row.
+ **/
+static void run_benchmark(char *name, Benchmark benchmark)
+{
+    double samples[NUM_SAMPLES];
+
+    // Warms up the caches and branch predictors before measuring
+    benchmark();
+
+    for (int i = 0; i < NUM_SAMPLES; i++)
+    {
+        double start = time_ns();
+
+        // Repeats the benchmark until the sample is long enough to time accurately
+        U64 num_operations = 0;
+        do
+        {
+            num_operations += benchmark();
+        } while (time_ns() - start < 1e6);
+
+        samples[i] = (time_ns() - start) / num_operations;
+    }
+
+    double mean = 0, variance = 0, min = samples[0];
+    for (int i = 0; i < NUM_SAMPLES; i++)
+    {
+        mean += samples[i] / NUM_SAMPLES;
+        min = (samples[i] < min) ? samples[i] : min;
+    }
+    for (int i = 0; i < NUM_SAMPLES; i++)
+        variance += (samples[i] - mean) * (samples[i] - mean) / (NUM_SAMPLES - 1);
+
+    printf("%s,%.3f,%.3f,%.3f,%i\n", name, mean, sqrt(variance), min, NUM_SAMPLES);
+}
+
+int main(int argc, char **argv)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+
+    load_positions((argc > 1) ? argv[1] : "tests/data/perftsuite.epd");
+    generate_slider_queries();
+    generate_endgame_positions();
+    generate_large_table();
+
+    printf("benchmark,ns_per_op,stddev_ns,min_ns,samples\n");
+    run_benchmark("lookup_rook_attacks", benchmark_rook_attacks);
+    run_benchmark("lookup_bishop_attacks", benchmark_bishop_attacks);
+    run_benchmark("lookup_queen_attacks", benchmark_queen_attacks);
+    run_benchmark("chessboard_generate_moves", benchmark_generate_moves);
+    run_benchmark("chessboard_make_move+undo_move", benchmark_make_undo_move);
+    run_benchmark("chessboard_squared_attacked", benchmark_squared_attacked);
+    run_benchmark("attack_fill_side", benchmark_attack_fill_side);
+    run_benchmark("chessboard_attack_info", benchmark_attack_info);
+    run_benchmark("chessboard_hash", benchmark_hash);
+    run_benchmark("strtok_fen_parse", benchmark_strtok_fen_parse);
+    run_benchmark("fen_parse", benchmark_fen_parse);
+    run_benchmark("fen_write", benchmark_fen_write);
+    run_benchmark("packed_encode", benchmark_packed_encode);
+    run_benchmark("packed_decode", benchmark_packed_decode);
+    run_benchmark("book_key", benchmark_book_key);
+    run_benchmark("tablebase_probe_wdl", benchmark_tablebase_probe_wdl);
+    run_benchmark("tablebase_probe_dtm", benchmark_tablebase_probe_dtm);
+    run_benchmark("table_probe", benchmark_table_probe);
+    run_benchmark("table_clear", benchmark_table_clear);
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+/*
+Batch analysis of EPD/FEN files.
+
+The calling thread streams the input file into a fixed window of slots which a
+pool of workers search in parallel, each with its own board, transposition
+table and evaluation cache. Results are written in input order: once the window
+is full the reader waits for the oldest position to be written, so memory stays
+bounded no matter the size of the input and a slow output throttles the reader.
+
+Every output line is the four position fields of the position's EPD (pieces,
+side to move, castling and en passent square) followed by EPD operations:
+
+ id    the id of the input line if it had one
+ hmvc  half move clock
+ fmvn  full move number
+ acd   depth of the last completed iteration
+ acn   nodes searched
+ ce    score in centipawns from the side to move, or dm with the moves to mate
+ pm    predicted (best) move
+ pv    principal variation
+
+Moves are written in coordinate notation like the UCI protocol. Lines that can
+not be parsed are written with a c0 operation describing the error instead.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "search.h"
+
+#define ANALYSIS_DEPTH 8
+#define ANALYSIS_HASH 16
+
+typedef struct
+{
+    int num_workers;
+
+    // Transposition table size of each worker in MB
+    int hash_size;
+
+    // Limits of the search of every position
+    SearchLimits limits;
+} AnalysisOptions;
+
+/**
+ * Analyzes every position of the input file with the given options, writing the
+ * results to the output file in input order. A summary is printed to stderr.
+ * Returns false if the workers could not be allocated.
+ **/
+bool analysis_run(FILE *input, FILE *output, AnalysisOptions *options);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef ATTACK_FILL_H
+#define ATTACK_FILL_H
+
+/*
+Setwise attack generation.
+
+Instead of looking up the attacks of one piece at a time, every rook, bishop and
+queen of a side is slid at once with an occluded Kogge-Stone fill: each of the
+eight directions takes three shift-and-mask steps to flood along the empty
+squares, whatever the number of pieces. The four directions that shift left and
+the four that shift right are each held in the lanes of one vector, so on AVX2
+all eight rays are filled with two vectors. Other processors use the same code
+without AVX2, and builds with DISABLE_SIMD or without x86-64 fill one direction
+at a time.
+*/
+
+#include "chessboard.h"
+
+/**
+ * Returns the squares attacked by all the given orthogonal and diagonal sliders
+ * with the given occupied squares. Queens belong to both sets.
+ **/
+BitBoard attack_fill_sliders(BitBoard orthogonal, BitBoard diagonal, BitBoard occupied);
+
+/**
+ * Returns the squares attacked by all the given knights.
+ **/
+BitBoard attack_fill_knights(BitBoard knights);
+
+/**
+ * Returns the squares attacked by all the given pawns of the given color.
+ **/
+BitBoard attack_fill_pawns(BitBoard pawns, int color);
+
+/**
+ * Returns every square attacked by the given color when the given squares are
+ * occupied.
+ **/
+BitBoard attack_fill_side(ChessBoard *board, int color, BitBoard occupied);
+
+#endif
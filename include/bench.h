@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include "defs.h"
+
+#define BENCH_DEPTH 6
+
+#define PERFT_DEPTH 4
+
+/**
+ * Returns the depth at the start of the given argument, or the given default
+ * if the argument is missing, does not start with a number or is not between
+ * one and MAX_PLY.
+ **/
+int bench_parse_depth(const char *arg, int default_depth);
+
+/**
+ * Searches every bench position to the given depth on a single thread with a
+ * freshly cleared transposition table, printing the total number of nodes
+ * searched and the nodes per second. Returns the total number of nodes, which
+ * only changes when the behaviour of the search changes. If use_counters is set
+ * the hardware performance counters of every search are reported per node.
+ **/
+U64 bench_run(int depth, bool use_counters);
+
+/**
+ * Runs perft to the given depth on every bench position, printing the total
+ * number of leaf nodes and the nodes per second. If use_counters is set the
+ * hardware performance counters of the move generation are reported per node.
+ **/
+U64 bench_perft(int depth, bool use_counters);
+
+#endif
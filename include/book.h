@@ -0,0 +1,75 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+/*
+Polyglot opening book lookup.
+
+A Polyglot book is a file of 16 byte big-endian entries sorted by key:
+
+ bytes 0-7    Polyglot key of the position
+ bytes 8-9    move: target square (bits 0-5), origin square (bits 6-11) and
+              promotion piece (bits 12-14: knight, bishop, rook, queen)
+ bytes 10-11  weight
+ bytes 12-15  learn data (ignored)
+
+The file is memory mapped, so opening a book costs the same regardless of its
+size and only the pages touched by the binary search are ever read. Polyglot
+keys are computed from their own table of random numbers, independently of the
+board's position_key. Castling is stored as the king capturing its own rook
+(e1h1 for e1g1) and book moves are only returned if they are legal on the board.
+*/
+
+#include <stdbool.h>
+#include "defs.h"
+#include "chessboard.h"
+
+#define BOOK_MAX_MOVES 64
+
+typedef enum
+{
+    BOOK_BEST,
+    BOOK_WEIGHTED,
+} BookSelection;
+
+typedef struct
+{
+    U8 *entries;
+    U64 size;
+    U64 num_entries;
+} Book;
+
+typedef struct
+{
+    Move move;
+    U16 weight;
+} BookMove;
+
+/**
+ * Memory maps a Polyglot book. Returns NULL if the file could not be mapped.
+ **/
+Book* book_open(char *filename);
+
+/**
+ * Unmaps the book.
+ **/
+void book_close(Book *book);
+
+/**
+ * Returns the Polyglot key of the board's position.
+ **/
+U64 book_key(ChessBoard *board);
+
+/**
+ * Fills moves with the legal book moves of the board's position, in the order
+ * of the book, and returns their number.
+ **/
+int book_probe(Book *book, ChessBoard *board, BookMove moves[BOOK_MAX_MOVES]);
+
+/**
+ * Returns the book move with the highest weight or, with BOOK_WEIGHTED, a move
+ * chosen with probability proportional to its weight using the given random
+ * number. NULL_MOVE is returned if the position is not in the book.
+ **/
+Move book_move(Book *book, ChessBoard *board, BookSelection selection, U64 random);
+
+#endif
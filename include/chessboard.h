@@ -6,6 +6,11 @@
 #include "bitboard.h"
 #include "move.h"
 
+#define REPETITION_FILTER_SIZE 1024
+
+// Slot of a position in the repetition filter
+#define RepetitionSlot(key) ((key) & (REPETITION_FILTER_SIZE - 1))
+
 typedef enum 
 {
     WHITE_KING_SIDE = 1,
@@ -17,9 +22,13 @@ typedef enum
 typedef struct
 {
     Move move;
+    U8 piece;
+    U8 captured_piece;
     U64 position_key;
     U8 en_passent_target;
     U8 castle_permission;
+    U16 num_half_moves;
+    U16 num_full_moves;
 } MoveInfo;
 
 typedef struct
@@ -42,10 +51,22 @@ typedef struct
 
     MoveInfo move_history[2048];
     int num_moves;
+
+    // Number of positions in the move history by slot of their key, so most
+    // positions are known not to repeat without scanning the history
+    U16 repetition_filter[REPETITION_FILTER_SIZE];
 } ChessBoard;
 
+// Zobrist keys indexed by piece - WHITE_PAWNS and square, castle permission and color
+U64 PIECE_KEYS[12][64];
+
+U64 CASTLE_KEYS[16];
+
+U64 SIDE_KEY[2];
+
 /**
- * Initializes a chessboard's pieces with a fen stirng.
+ * Initializes a chessboard's pieces with a fen stirng. Use fen_parse to
+ * detect malformed strings.
  **/
 void chessboard_init(ChessBoard *board, char *fen_str);
 
@@ -64,6 +85,28 @@ void chessboard_init_keys(void);
  **/
 Piece chessboard_get_piece(ChessBoard *board, BitBoard square_mask);
 
+/**
+ * Returns whether the current position occured before since the last capture
+ * or pawn move.
+ **/
+bool chessboard_is_repetition(ChessBoard *board);
+
+/**
+ * Returns whether the game is drawn by repetition or the fifty move rule.
+ **/
+bool chessboard_is_draw(ChessBoard *board);
+
+/**
+ * Returns the piece moved by the given move, which has not been played yet.
+ **/
+Piece chessboard_moved_piece(ChessBoard *board, Move move);
+
+/**
+ * Returns the piece captured by the given move, which has not been played
+ * yet, or EMPTY if the move is not a capture.
+ **/
+Piece chessboard_captured_piece(ChessBoard *board, Move move);
+
 /**
  * Returns whether the given square is being attacked by an opponent
  * piece.
@@ -75,13 +118,57 @@ bool chessboard_squared_attacked(ChessBoard *board, int target);
  **/
 void chessboard_move_piece(ChessBoard *board, Move move);
 
+/**
+ * Returns the position key the board will have after the given pseudo legal
+ * move is played, updating the current key with only the squares the move
+ * changes.
+ **/
+U64 chessboard_key_after(ChessBoard *board, Move move);
+
 /**
  * Updates the chessboard's pieces after the given pseudo legal move is played. 
  * Returns whether the move is legal. If the move is not legal the board is not
- * updated.
+ * updated. The null move is never legal.
  **/
 bool chessboard_make_move(ChessBoard *board, Move move);
 
+/**
+ * Same as chessboard_make_move, but takes the key the move leads to from the
+ * caller, who already computed it with chessboard_key_after.
+ **/
+bool chessboard_make_move_with_key(ChessBoard *board, Move move, U64 key);
+
+/**
+ * Fills the attacks on the side to move: checkers, pinned pieces, the squares
+ * the king can not move to and the targets that resolve a check.
+ **/
+void chessboard_attack_info(ChessBoard *board, AttackInfo *attacks);
+
+/**
+ * Returns whether the pseudo legal move leaves the king of the side to move
+ * safe, using the attacks of the position instead of playing the move.
+ **/
+bool chessboard_is_legal(ChessBoard *board, AttackInfo *attacks, Move move);
+
+/**
+ * Returns whether the move could have been generated in the current position,
+ * so a move from the transposition table or a book can be played without
+ * generating every move.
+ **/
+bool chessboard_is_pseudo_legal(ChessBoard *board, Move move);
+
+/**
+ * Updates the chessboard's pieces after the given legal move is played,
+ * without testing whether it leaves the king in check.
+ **/
+void chessboard_play_move(ChessBoard *board, Move move);
+
+/**
+ * Same as chessboard_play_move, but takes the key the move leads to from the
+ * caller, who already computed it with chessboard_key_after.
+ **/
+void chessboard_play_move_with_key(ChessBoard *board, Move move, U64 key);
+
 /**
  * Updates the chessboard's pieces after undoing the last moved played.
  **/
@@ -89,10 +176,16 @@ void chessboard_undo_move(ChessBoard *board);
 
 /**
  * Generates all possible pseudo legal moves in a given possition 
- * and adds them to the given MoveList.
+ * and adds them to the given MoveList, along with the attacks on the
+ * side to move.
  **/
 void chessboard_generate_moves(ChessBoard *board, MoveList *list);
 
+/**
+ * Returns the number of leaf nodes of the legal move tree of the given depth.
+ **/
+U64 chessboard_perft(ChessBoard *board, int depth);
+
 /**
  * Prints a formated representation of a chessboard.
  **/
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 typedef uint8_t U8;
+typedef uint16_t U16;
 typedef uint32_t U32;
 typedef uint64_t U64;
 
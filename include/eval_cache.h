@@ -0,0 +1,61 @@
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include <stdbool.h>
+#include "defs.h"
+
+/*
+Every entry of the evaluation cache is a single U64:
+
+ 63                              32 31                               0
+ | upper 32 bits of position key   | static evaluation (signed)      |
+
+The lower bits of the key select the slot and the upper bits are kept to verify
+the entry, so a whole entry is read and written with one aligned 64 bit access.
+A reader can therefore never observe half of an entry written by another thread
+which lets the cache be probed and filled without any locking. Hits and misses
+are counted in each thread's stats (make stats) rather than in the shared cache.
+*/
+
+typedef struct
+{
+    U64 *entries;
+    U64 mask;
+} EvalCache;
+
+/**
+ * Returns an evaluation cache with room for the given number of entries (rounded
+ * down to a power of two) whose entries are allocated on huge pages. Null will
+ * be returned if the cache was not able to be allocated.
+ **/
+EvalCache* eval_cache_init(int size);
+
+/**
+ * Frees the memory the evaluation cache was taking up.
+ **/
+void eval_cache_free(EvalCache *cache);
+
+/**
+ * Removes every entry from the evaluation cache.
+ **/
+void eval_cache_clear(EvalCache *cache);
+
+/**
+ * Starts loading the slot of the given key into the cache, so a probe issued
+ * shortly after does not wait on memory.
+ **/
+void eval_cache_prefetch(EvalCache *cache, U64 key);
+
+/**
+ * Looks up the static evaluation stored for the given position key. Returns
+ * whether the key was found, in which case score is filled with the evaluation.
+ **/
+bool eval_cache_probe(EvalCache *cache, U64 key, int *score);
+
+/**
+ * Stores the static evaluation of the position with the given key, replacing
+ * whatever entry previously occupied its slot.
+ **/
+void eval_cache_store(EvalCache *cache, U64 key, int score);
+
+#endif
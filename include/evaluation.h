@@ -0,0 +1,42 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+/*
+The static evaluation is a weighted sum of terms, each counted for white minus
+black. Keeping it linear in EVAL_WEIGHTS lets the tuner extract the term
+coefficients of a position once and fit the weights with a dot product per
+position. New terms must be added to EvalTerm, EVAL_TERM_NAMES and
+evaluation_terms, with their default weight in EVAL_WEIGHTS.
+
+Weights are in tenths of a pawn.
+*/
+
+#include "defs.h"
+#include "chessboard.h"
+
+typedef enum
+{
+    TERM_PAWN,
+    TERM_ROOK,
+    TERM_KNIGHT,
+    TERM_BISHOP,
+    TERM_QUEEN,
+    NUM_EVAL_TERMS,
+} EvalTerm;
+
+int EVAL_WEIGHTS[NUM_EVAL_TERMS];
+
+char *EVAL_TERM_NAMES[NUM_EVAL_TERMS];
+
+/**
+ * Fills the coefficients of every term for the board from white's point of
+ * view, such that the evaluation is the sum of coefficient times weight.
+ **/
+void evaluation_terms(ChessBoard *board, int coefficients[NUM_EVAL_TERMS]);
+
+/**
+ * Returns the evaluation of the board from white's point of view.
+ **/
+int evaluation_evaluate(ChessBoard *board);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef FEN_H
+#define FEN_H
+
+/*
+Parsing and writing of FEN and EPD strings.
+
+The parser is reentrant and never allocates: it reads the string in a single
+pass into the bitboards of a board on the stack and reports the first malformed
+field, copying the position out only once every field parsed, so a malformed
+string leaves the board untouched. EPD lines are the first
+four FEN fields followed by optional clocks and ';' separated operations, of
+which bm (best moves in SAN), id, hmvc, fmvn and the perft counts D1 to D6 are
+understood. Other operations are skipped.
+*/
+
+#include "defs.h"
+#include "chessboard.h"
+
+// 71 characters of piece placement plus " w KQkq e3 " and two 10 digit clocks
+#define FEN_MAX_LENGTH 104
+
+#define EPD_MAX_BEST_MOVES 8
+#define EPD_MAX_ID_LENGTH 64
+#define EPD_MAX_PERFT_DEPTH 6
+
+typedef enum
+{
+    FEN_OK,
+    FEN_INVALID_PIECES,
+    FEN_INVALID_KINGS,
+    FEN_INVALID_COLOR,
+    FEN_INVALID_CASTLING,
+    FEN_INVALID_EN_PASSENT,
+    FEN_INVALID_CLOCKS,
+    EPD_INVALID_OPERATION,
+    EPD_INVALID_MOVE,
+} FenError;
+
+typedef struct
+{
+    char id[EPD_MAX_ID_LENGTH];
+    Move best_moves[EPD_MAX_BEST_MOVES];
+    int num_best_moves;
+
+    // Number of leaf nodes at each depth, 0 if the operation is missing
+    U64 perft[EPD_MAX_PERFT_DEPTH + 1];
+} EpdRecord;
+
+/**
+ * Initializes the board with the given FEN string. The clocks are optional and
+ * default to 0 and 1. If end is not NULL it is set to the first character after
+ * the parsed fields. Returns FEN_OK or the first field that is malformed, in
+ * which case the board is left untouched.
+ **/
+FenError fen_parse(ChessBoard *board, char *fen, char **end);
+
+/**
+ * Writes the board's FEN string into the given buffer, which must hold at
+ * least FEN_MAX_LENGTH characters. Returns the length of the string.
+ **/
+int fen_write(ChessBoard *board, char *fen);
+
+/**
+ * Writes the four position fields of the board's EPD string, without the move
+ * clocks, into the given buffer, which must hold at least FEN_MAX_LENGTH
+ * characters. Returns the length of the string.
+ **/
+int epd_write(ChessBoard *board, char *epd);
+
+/**
+ * Initializes the board and the record with the given EPD line. Returns FEN_OK
+ * or the first field or operation that is malformed.
+ **/
+FenError epd_parse(ChessBoard *board, EpdRecord *record, char *line);
+
+/**
+ * Returns the legal move written in standard algebraic notation, or NULL_MOVE
+ * if the move is illegal or ambiguous. Only the first length characters of
+ * san are read.
+ **/
+Move fen_parse_san(ChessBoard *board, char *san, int length);
+
+/**
+ * Returns a description of the given error.
+ **/
+char* fen_error_string(FenError error);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+/*
+Allocation of large tables such as the transposition table.
+
+Tables are mapped in 2 MB aligned blocks. Reserved huge pages are used when the
+system has them, otherwise the block is advised to be backed by transparent
+huge pages, so a probe anywhere in a multi gigabyte table needs one TLB entry
+per 2 MB instead of per 4 KB. The pages are only touched when first written,
+and clearing a table splits it into 2 MB aligned slices over several threads,
+so a fresh multi gigabyte table is faulted in and zeroed in parallel rather
+than during the first search. The clearing threads are not pinned, and pages
+that are already mapped stay on whatever NUMA node they were first placed.
+*/
+
+#include "defs.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define MAX_CLEAR_THREADS 256
+
+/**
+ * Returns zeroed memory of at least the given size aligned to a huge page.
+ * Null will be returned if the memory could not be mapped.
+ **/
+void* huge_pages_alloc(U64 size);
+
+/**
+ * Unmaps memory returned by huge_pages_alloc for the given size.
+ **/
+void huge_pages_free(void *memory, U64 size);
+
+/**
+ * Zeroes the memory on num_threads threads, each clearing its own slice.
+ **/
+void huge_pages_clear(void *memory, U64 size, int num_threads);
+
+#endif
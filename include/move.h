@@ -2,6 +2,7 @@
 #define MOVE_H
 
 #include "defs.h"
+#include "bitboard.h"
 
 typedef enum
 {
@@ -15,19 +16,57 @@ typedef enum
     QUEEN_PROMOTION,
 } MoveType;
 
-typedef struct 
+/*
+A move is packed into 16 bits:
+
+ bits  0-5   origin square
+ bits  6-11  target square
+ bits 12-14  move type
+
+The moving and captured pieces are not stored since they can be read from the
+board the move is played on.
+*/
+typedef U16 Move;
+
+#define CreateMove(origin, target, type) ((Move) ((origin) | (target) << 6 | (type) << 12))
+
+#define MoveOrigin(m) ((m) & 0x3f)
+
+#define MoveTarget(m) (((m) >> 6) & 0x3f)
+
+#define MoveType(m) ((m) >> 12)
+
+#define NULL_MOVE ((Move) 0)
+
+#define IsNullMove(m) (MoveOrigin(m) == MoveTarget(m))
+
+#define SameMove(a, b) ((a) == (b))
+
+// Attacks on the side to move, computed once per position by the move generator
+typedef struct
 {
-    U8 origin;
-    U8 target;
-    U8 piece : 4;
-    U8 captured_piece : 4;
-    U8 move_type;
-} Move;
+    // Opponent pieces giving check
+    BitBoard checkers;
+
+    // Pieces of the side to move pinned to their king
+    BitBoard pinned;
+
+    // Squares attacked by the opponent, with rays passing through the king
+    BitBoard king_danger;
+
+    // Targets that resolve a check: every square when not in check, none in double check
+    BitBoard check_mask;
+} AttackInfo;
 
 typedef struct
 {
     Move moves[256];
+
+    // Ordering score of each move, kept apart from the moves so both are contiguous
+    int16_t scores[256];
     U8 size;
+
+    AttackInfo attacks;
 } MoveList;
 
 typedef struct
@@ -0,0 +1,140 @@
+#ifndef PACKED_POSITION_H
+#define PACKED_POSITION_H
+
+/*
+Compact fixed-size positions for datasets and their container file format.
+
+A PackedPosition takes 32 bytes: the occupancy bitboard, followed by the
+Piece of every occupied square in ascending square order stored as 4-bit codes
+(at most 32 pieces fit in 16 bytes), the side to move and castling permissions,
+the en passent square and both move clocks.
+
+Container files hold fixed-size records, usually a PackedPosition followed by
+whatever labels a dataset needs, grouped into chunks:
+
+ header   "CEPACK01", U32 record size, U32 records per chunk, U32 flags
+ chunk    U32 number of records, U32 stored size, stored bytes
+ ...
+ index    U64 file offset of every chunk
+ trailer  U64 index offset, U64 number of records, "CEPACKIX"
+
+With PACKED_COMPRESSED set every record of a chunk is stored as the XOR with
+the previous record: a mask of the bytes that differ followed by those bytes.
+Consecutive positions of a game share most of their bytes, which makes this
+cheap scheme effective. The index lets a reader jump to any record by reading
+only the chunk that contains it. Numbers are stored in host byte order.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "defs.h"
+#include "chessboard.h"
+
+#define PACKED_CHUNK_SIZE 4096
+#define PACKED_MAX_CHUNK_SIZE (1 << 20)
+#define PACKED_MAX_RECORD_SIZE 64
+
+#define PACKED_COMPRESSED 1
+
+typedef struct
+{
+    BitBoard occupancy;
+    U8 pieces[16];
+    U8 color_castling;
+    U8 en_passent;
+    U16 num_half_moves;
+    U16 num_full_moves;
+    U16 padding;
+} PackedPosition;
+
+typedef struct
+{
+    FILE *file;
+    U32 record_size;
+    U32 chunk_size;
+    U32 flags;
+
+    U8 *chunk;
+    U8 *buffer;
+    U32 chunk_length;
+
+    U64 *offsets;
+    U64 num_chunks;
+    U64 max_chunks;
+    U64 num_records;
+} PackedWriter;
+
+typedef struct
+{
+    FILE *file;
+    U32 record_size;
+    U32 chunk_size;
+    U32 flags;
+
+    U8 *chunk;
+    U8 *buffer;
+    U32 chunk_length;
+    U32 chunk_position;
+
+    // Index of the decoded chunk, (U64) -1 before the first one is read
+    U64 current_chunk;
+
+    U64 *offsets;
+    U64 num_chunks;
+    U64 num_records;
+} PackedReader;
+
+/**
+ * Packs the board's position into 32 bytes. Returns false if the board has
+ * more than 32 pieces, which do not fit.
+ **/
+bool packed_encode(ChessBoard *board, PackedPosition *packed);
+
+/**
+ * Initializes the board with the packed position.
+ **/
+void packed_decode(PackedPosition *packed, ChessBoard *board);
+
+/**
+ * Creates a container file for records of record_size bytes. Returns NULL if
+ * the file could not be created.
+ **/
+PackedWriter* packed_writer_open(char *filename, U32 record_size, U32 flags);
+
+/**
+ * Appends a record to the container. Returns false on write errors.
+ **/
+bool packed_writer_add(PackedWriter *writer, void *record);
+
+/**
+ * Writes the last chunk and the index and closes the container. Returns false
+ * on write errors.
+ **/
+bool packed_writer_close(PackedWriter *writer);
+
+/**
+ * Opens a container file written by a PackedWriter. Returns NULL if the file
+ * could not be read or is not a container, including files whose chunks hold
+ * more than PACKED_MAX_CHUNK_SIZE records or whose index does not match the
+ * number of records.
+ **/
+PackedReader* packed_reader_open(char *filename);
+
+/**
+ * Reads the next record into the given buffer. Returns false once every record
+ * has been read.
+ **/
+bool packed_reader_next(PackedReader *reader, void *record);
+
+/**
+ * Reads the record with the given index into the given buffer and continues
+ * sequential reading after it. Returns false if the index is out of range.
+ **/
+bool packed_reader_get(PackedReader *reader, U64 index, void *record);
+
+/**
+ * Closes the container file.
+ **/
+void packed_reader_close(PackedReader *reader);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include "defs.h"
+
+typedef enum
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    NUM_COUNTERS,
+} CounterType;
+
+typedef struct
+{
+    int fds[NUM_COUNTERS];
+    U64 values[NUM_COUNTERS];
+} PerfCounters;
+
+/**
+ * Opens the hardware performance counters of the calling thread with Linux's
+ * perf_event_open. Counters the kernel or hardware does not support are left
+ * closed. Returns whether at least one counter could be opened.
+ **/
+bool perf_counters_open(PerfCounters *counters);
+
+/**
+ * Closes every open performance counter.
+ **/
+void perf_counters_close(PerfCounters *counters);
+
+/**
+ * Clears the accumulated counter values.
+ **/
+void perf_counters_reset(PerfCounters *counters);
+
+/**
+ * Starts counting events for a measured region.
+ **/
+void perf_counters_start(PerfCounters *counters);
+
+/**
+ * Stops counting events and adds the events of the measured region to the
+ * accumulated counter values.
+ **/
+void perf_counters_stop(PerfCounters *counters);
+
+/**
+ * Prints the accumulated counter values of the named region, both in total and
+ * divided by the number of nodes visited in it.
+ **/
+void perf_counters_print(PerfCounters *counters, char *region, U64 nodes);
+
+#endif
@@ -1,13 +1,136 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <stdbool.h>
+#include <stdatomic.h>
 #include "chessboard.h"
 #include "move.h"
+#include "eval_cache.h"
+#include "transposition_table.h"
+
+#define MAX_PLY 64
+
+#define MAX_MULTI_PV 64
+
+#define INFINITE_SCORE 32000
+
+#define MATE_SCORE 31000
+
+// Longest mate in plies that is scored, long enough for the mates of the endgame tables at the root
+#define MAX_MATE_PLIES 256
+
+// Scores of positions the endgame tables know to be won, less the ply they are reached at
+#define TABLEBASE_WIN_SCORE (MATE_SCORE - MAX_MATE_PLIES - MAX_PLY)
+
+// Centipawns reported for a tablebase win, less the ply it is reached at
+#define TABLEBASE_WIN_CP 20000
+
+#define IsMateScore(score) ((score) >= MATE_SCORE - MAX_MATE_PLIES || (score) <= -MATE_SCORE + MAX_MATE_PLIES)
+
+#define IsTablebaseScore(score) (!IsMateScore(score) \
+    && ((score) >= TABLEBASE_WIN_SCORE - MAX_PLY || (score) <= -TABLEBASE_WIN_SCORE + MAX_PLY))
+
+typedef struct
+{
+    int depth;
+    U64 nodes;
+    long move_time;
+    long time[2];
+    long increment[2];
+    int moves_to_go;
+    bool infinite;
+} SearchLimits;
+
+typedef struct
+{
+    Move moves[MAX_PLY];
+    int size;
+} PrincipalVariation;
+
+typedef struct SearchInfo SearchInfo;
+
+/**
+ * Called by the main search thread after every completed iteration with the
+ * depth reached, the score of the position and its principal variation. With
+ * several lines it is called once per line, the best line being line 0.
+ **/
+typedef void (*SearchReport)(SearchInfo *info, int depth, int line, int score, PrincipalVariation *pv);
+
+/*
+The SearchInfo is shared by every thread searching the same position. Each
+thread searches its own copy of the board and only communicates with the other
+threads through the transposition table and the atomic fields below.
+*/
+struct SearchInfo
+{
+    SearchLimits limits;
+    TranspositionTable *table;
+    EvalCache *eval_cache;
+    int num_threads;
+    SearchReport report;
+
+    // Number of best lines searched at the root, one if not set
+    int multi_pv;
+
+    atomic_bool stop;
+    atomic_bool pondering;
+    atomic_ullong nodes;
+    atomic_long start_time;
+    long time_budget;
+};
+
+typedef struct
+{
+    SearchInfo *info;
+    ChessBoard board;
+    int id;
+    int ply;
+
+    U64 nodes;
+    U64 flushed_nodes;
+
+    PrincipalVariation pv[MAX_PLY + 1];
+
+    // Root moves skipped by the search, the first moves of the better lines
+    Move excluded[MAX_MULTI_PV];
+    int num_excluded;
+} SearchThread;
+
+/**
+ * Returns the time in milliseconds from an arbitrary fixed point.
+ **/
+long search_time(void);
+
+/**
+ * Switches a search started while pondering to a normal search that respects
+ * its time limits, measured from now.
+ **/
+void search_ponderhit(SearchInfo *info);
 
 int search_evaluation(ChessBoard *board);
 
-int search_negamax(ChessBoard *board, int depth, int alpha, int beta);
+/**
+ * Returns the number of moves to the mate of the given mate score, negative if
+ * the side to move is mated.
+ **/
+int search_mate_moves(int score);
+
+/**
+ * Returns the given score, which is not a mate score, in centipawns. Wins and
+ * losses of the endgame tables are reported as TABLEBASE_WIN_CP less the ply
+ * they are reached at rather than scaled like evaluations.
+ **/
+int search_centipawns(int score);
+
+int search_negamax(SearchThread *thread, int depth, int alpha, int beta);
 
-Move search_position(ChessBoard *board);
+/**
+ * Searches the board with iterative deepening until the limits in info are
+ * reached or info->stop is set, and returns the best move. The search is run
+ * on info->num_threads threads sharing the transposition table. With
+ * info->multi_pv lines, every iteration searches the best line, then the best
+ * line without the moves of the lines before it, and so on.
+ **/
+Move search_position(SearchInfo *info, ChessBoard *board);
 
-#endif
\ No newline at end of file
+#endif
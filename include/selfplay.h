@@ -0,0 +1,64 @@
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+/*
+Self-play generation of training data.
+
+Every thread plays its own games, starting from the initial position followed
+by a few random legal moves, and chooses each move with a fixed-node search.
+Quiet positions (side to move not in check and a best move that is neither a
+capture nor a promotion) are labeled with the search score and, once the game
+is over, its result. A thread collects records in its own buffer and only takes
+the lock on the output container when the buffer is full.
+
+Games end on mate, stalemate, the fifty move rule, a repetition, bare kings or
+SELFPLAY_MAX_PLIES, or are adjudicated as won once both sides agree that the
+same color leads by at least SELFPLAY_WIN_SCORE for SELFPLAY_WIN_PLIES plies in
+a row.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "defs.h"
+#include "packed_position.h"
+
+#define SELFPLAY_NODES 5000
+#define SELFPLAY_RANDOM_PLIES 8
+#define SELFPLAY_HASH 4
+#define SELFPLAY_MAX_PLIES 400
+#define SELFPLAY_WIN_SCORE 100
+#define SELFPLAY_WIN_PLIES 4
+
+typedef struct
+{
+    PackedPosition position;
+
+    // Search score and game result (1, 0 or -1) from white's point of view
+    int16_t score;
+    U16 best_move;
+    int8_t result;
+    U8 padding[3];
+} SelfplayRecord;
+
+typedef struct
+{
+    int num_threads;
+    U64 num_games;
+    U64 nodes;
+    int random_plies;
+
+    // Transposition table size of each thread in MB
+    int hash_size;
+
+    // Seed of the random openings; the same seed and options replay the same games
+    U64 seed;
+} SelfplayOptions;
+
+/**
+ * Plays the given number of self-play games and writes their records to a
+ * container file, reporting progress and positions per second per core to
+ * stderr. Returns false if the file or the threads could not be created.
+ **/
+bool selfplay_run(char *filename, SelfplayOptions *options);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+Hot path instrumentation that is only compiled in when ENABLE_STATS is defined
+(make stats). Otherwise every macro below expands to nothing, so the release
+build pays nothing for the instrumentation left in the code.
+
+Each thread counts into its own thread local Stats, which it merges into the
+global totals with StatsMerge once it stops searching. Phase timers read the
+time stamp counter and are inclusive: the cycles of a phase include those of
+any phase it calls.
+*/
+
+#ifdef ENABLE_STATS
+
+#include <stdio.h>
+#include "defs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define MAX_CUTOFF_INDEX 16
+
+typedef enum
+{
+    PHASE_GENERATE_MOVES,
+    PHASE_MAKE_MOVE,
+    PHASE_UNDO_MOVE,
+    PHASE_EVALUATION,
+    PHASE_TABLE_PROBE,
+    PHASE_TABLE_STORE,
+    NUM_PHASES,
+} Phase;
+
+typedef struct
+{
+    U64 calls[NUM_PHASES];
+    U64 cycles[NUM_PHASES];
+    U64 illegal_moves;
+    U64 table_hits;
+    U64 table_misses;
+    U64 eval_cache_hits;
+    U64 eval_cache_misses;
+    U64 table_move_cutoffs;
+    U64 cutoffs[MAX_CUTOFF_INDEX];
+} Stats;
+
+extern _Thread_local Stats thread_stats;
+
+/**
+ * Returns the current value of the time stamp counter.
+ **/
+static inline U64 stats_time(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (U64) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * Adds the calling thread's stats to the global totals and clears them.
+ **/
+void stats_merge(void);
+
+/**
+ * Prints the global totals as JSON to the given file and clears them.
+ **/
+void stats_dump(FILE *file);
+
+#define StatsIncrement(counter) (thread_stats.counter++)
+
+#define StatsCutoff(index) (thread_stats.cutoffs[((index) < MAX_CUTOFF_INDEX) ? (index) : MAX_CUTOFF_INDEX - 1]++)
+
+#define StatsBegin(phase) U64 stats_start_##phase = stats_time()
+
+#define StatsEnd(phase) \
+    (thread_stats.calls[PHASE_##phase]++, thread_stats.cycles[PHASE_##phase] += stats_time() - stats_start_##phase)
+
+#define StatsMerge() stats_merge()
+
+#define StatsDump() (stats_merge(), stats_dump(stderr))
+
+#else
+
+#define StatsIncrement(counter) ((void) 0)
+
+#define StatsCutoff(index) ((void) 0)
+
+#define StatsBegin(phase)
+
+#define StatsEnd(phase) ((void) 0)
+
+#define StatsMerge() ((void) 0)
+
+#define StatsDump() ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+/*
+Endgame tablebases generated locally by retrograde analysis.
+
+A table covers one material balance, named like KQvKR with the stronger side
+as white; positions with the colors reversed are probed by mirroring the board.
+Positions are indexed by the square of every piece, kings first. Without pawns
+the white king is mapped into the a1-d1-d4 triangle by the 8 symmetries of the
+board, with pawns it is mapped onto files a-d by mirroring. Only the smallest
+index of symmetric positions is used, the others are marked invalid.
+
+Generation starts by resolving every position whose moves all leave the table
+(captures and promotions, probed in the smaller tables generated beforehand)
+as well as checkmates and stalemates. Each following pass takes the positions
+resolved at the previous distance and walks their moves backwards, unmoving the
+pieces of the side that just moved with the attack lookups of the move
+generator. A predecessor of a loss is a win one ply further away, a predecessor
+of a win is a loss once all of its moves are known to lose. Passes are split
+over a pool of threads.
+
+Every table is stored in two files of 32 byte header ("CETBDTM1" or "CETBWDL1",
+the name in 16 bytes and the number of positions per side to move as a U64)
+followed by the positions with white to move and then black to move:
+
+ .dtm  one byte per position: 0 for a draw, 255 for an invalid position and
+       otherwise 1 plus the number of plies to mate, which is odd if the side
+       to move wins and even if it loses
+ .wdl  two bits per position: 0 loss, 1 draw, 2 win, 3 invalid
+
+Both files are memory mapped. The search probes the compact WDL tables at
+interior nodes and uses the DTM tables to choose the move at the root. Tables
+ignore en passent captures, castling and the fifty move rule, so positions with
+en passent or castling rights are never probed. A double push would still be
+scored as if the en passent capture it allows did not exist, so tables with
+pawns on both sides are neither generated nor mapped.
+*/
+
+#include <stdbool.h>
+#include "defs.h"
+#include "chessboard.h"
+
+#define TABLEBASE_MAX_PIECES 5
+#define TABLEBASE_MAX_TABLES 512
+
+typedef enum
+{
+    TABLEBASE_LOSS,
+    TABLEBASE_DRAW,
+    TABLEBASE_WIN,
+    TABLEBASE_INVALID,
+} TablebaseWdl;
+
+typedef struct
+{
+    char name[16];
+
+    // Number of pieces of every kind but kings, 4 bits per Piece - WHITE_PAWNS
+    U64 material;
+
+    // Pieces in index order: kings, then white and black pieces from queens to pawns
+    Piece pieces[TABLEBASE_MAX_PIECES];
+    int num_pieces;
+    bool has_pawns;
+
+    // Number of positions per side to move
+    U64 size;
+
+    U8 *dtm;
+    U8 *wdl;
+    U8 *dtm_file;
+    U8 *wdl_file;
+} Tablebase;
+
+/**
+ * Maps every table found in the directory, replacing the tables mapped before.
+ * Returns the number of tables mapped.
+ **/
+int tablebase_init(char *directory);
+
+/**
+ * Unmaps every table.
+ **/
+void tablebase_free(void);
+
+/**
+ * Generates the table of the given material (e.g. KRvK), or every table with
+ * the given number of pieces (e.g. 4), on num_threads threads and writes it to
+ * the directory, first generating any smaller table reached by captures or
+ * promotions that is missing. Tables with pawns on both sides are skipped.
+ * Returns false if the material is not valid, has pawns on both sides, or a
+ * table could not be written.
+ **/
+bool tablebase_generate(char *directory, char *material, int num_threads);
+
+/**
+ * Probes the WDL tables. Returns false if the position is not in a table,
+ * otherwise sets wdl to the result for the side to move.
+ **/
+bool tablebase_probe_wdl(ChessBoard *board, TablebaseWdl *wdl);
+
+/**
+ * Probes the DTM tables. Returns false if the position is not in a table,
+ * otherwise sets wdl to the result for the side to move and plies to the
+ * number of plies to mate (0 for draws).
+ **/
+bool tablebase_probe_dtm(ChessBoard *board, TablebaseWdl *wdl, int *plies);
+
+/**
+ * Chooses the legal move that mates fastest, keeps a draw or delays mate the
+ * longest. Returns false if the position or one of its moves is not in a
+ * table, otherwise sets move and the result of the position as
+ * tablebase_probe_dtm.
+ **/
+bool tablebase_root_move(ChessBoard *board, Move *move, TablebaseWdl *wdl, int *plies);
+
+#endif
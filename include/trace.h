@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+Timeline tracing of search events that is only compiled in when ENABLE_TRACE is
+defined (make trace). Otherwise TraceEvent expands to nothing.
+
+Every thread records events into its own single producer ring buffer, so
+recording an event never takes a lock. A background thread drains the rings
+into a binary trace file, which trace_convert turns into the Chrome trace
+format (chrome://tracing or https://ui.perfetto.dev). If a ring fills up before
+it is drained the newest events are dropped rather than blocking the search.
+
+The trace file starts with the 8 byte magic "CETRACE1" followed by 16 byte
+records:
+
+ bytes 0-7    time in nanoseconds
+ bytes 8-11   argument (depth, hash size or stop reason)
+ byte  12     event type
+ byte  13     ring buffer (thread) id
+*/
+
+#include <stdbool.h>
+#include "defs.h"
+
+typedef enum
+{
+    TRACE_SEARCH_START,
+    TRACE_SEARCH_END,
+    TRACE_ITERATION_START,
+    TRACE_ITERATION_END,
+    TRACE_ASPIRATION_RESEARCH,
+    TRACE_TABLE_RESIZE,
+    TRACE_STOP,
+    NUM_TRACE_EVENTS,
+} TraceType;
+
+typedef enum
+{
+    STOP_REQUESTED,
+    STOP_TIME,
+    STOP_NODES,
+} StopReason;
+
+typedef struct
+{
+    U64 time;
+    U32 arg;
+    U8 type;
+    U8 thread;
+    U16 padding;
+} TraceRecord;
+
+/**
+ * Converts the binary trace file into a Chrome trace JSON file. Returns
+ * whether the conversion succeeded.
+ **/
+bool trace_convert(char *trace_filename, char *json_filename);
+
+#ifdef ENABLE_TRACE
+
+/**
+ * Starts recording events into the given trace file. Returns whether the file
+ * could be opened.
+ **/
+bool trace_open(char *filename);
+
+/**
+ * Stops recording events, writes every buffered event and closes the trace file.
+ **/
+void trace_close(void);
+
+/**
+ * Records an event of the calling thread if a trace file is open.
+ **/
+void trace_record(TraceType type, U32 arg);
+
+#define TraceEvent(type, arg) trace_record(type, arg)
+
+#else
+
+#define TraceEvent(type, arg) ((void) 0)
+
+#endif
+
+#endif
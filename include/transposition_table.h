@@ -1,52 +1,145 @@
 #ifndef TRANSPOTION_TABLE_H
 #define TRANSPOTION_TABLE_H
 
+#include <stdbool.h>
 #include "defs.h"
 #include "move.h"
 
-typedef struct 
+#define TABLE_FILE_VERSION 2
+
+/*
+Each entry stores the data of a searched position packed into a single U64:
+
+ bits  0-15  move
+ bits 16-31  score
+ bits 32-39  depth
+ bits 40-41  bound
+ bits 42-47  age of the search that stored the entry, modulo 64
+ bits 48-63  upper 16 bits of the key
+
+The slot already depends on the key, so the upper bits of the key are enough to
+tell apart the positions sharing it. Search threads read and write entries
+without locking, which is safe since an entry is written and read as one U64.
+
+A table can be saved to a file and loaded back, or memory mapped from a file so
+every store is written through to it. The file starts with a 48 byte header:
+
+ bytes  0-7   magic "CETTABLE"
+ bytes  8-11  version of the entry layout above (TABLE_FILE_VERSION)
+ bytes 12-15  size of an entry in bytes
+ bytes 16-23  fingerprint of the Zobrist keys the entries were stored with
+ bytes 24-31  number of entries
+ bytes 32     age of the last search
+ bytes 33-47  unused
+
+followed by the entries in native byte order. Files written with another entry
+layout or other keys are rejected, since their entries would match the wrong
+positions.
+*/
+
+typedef enum
 {
-    U64 key;
-    Move move;
-    bool deleted;
-    bool occupied;
+    BOUND_NONE,
+    BOUND_UPPER,
+    BOUND_LOWER,
+    BOUND_EXACT,
+} Bound;
+
+typedef struct
+{
+    U64 data;
 } Entry;
 
-typedef struct 
+typedef struct
+{
+    Move move;
+    int score;
+    int depth;
+    Bound bound;
+} EntryData;
+
+typedef struct
 {
     Entry *entries;
-    int num_entries;
-    int size;
+    U64 size;
+    U8 age;
+
+    // Start of the file the table is mapped from, null for tables on the heap
+    U8 *file;
+
+    // Device and inode of the mapped file, to recognize saves to that same file
+    U64 file_device;
+    U64 file_inode;
 } TranspositionTable;
 
 /**
- * Returns a transposition table of the given size that was allocated on the heap. Null will be
- * returned if the table was not able to be allocated on the heap.
+ * Returns a transposition table of the given size whose entries are allocated
+ * on huge pages. Null will be returned if the table was not able to be allocated.
  **/
-TranspositionTable* table_init(int size);
+TranspositionTable* table_init(U64 size);
 
+/**
+ * Memory maps the table stored in the given file so every change is written
+ * through to it, creating a table of the given size if the file does not
+ * exist. Null will be returned if the file could not be mapped or was written
+ * with another entry layout or other keys.
+ **/
+TranspositionTable* table_map(char *filename, U64 size);
+
+/**
+ * Returns a transposition table allocated on the heap with the entries of the
+ * table saved in the given file. Null will be returned if the file could not
+ * be read or was written with another entry layout or other keys.
+ **/
+TranspositionTable* table_load(char *filename);
 
 /**
- * Frees the memory the transposition table was taking up.
+ * Saves the entries of the transposition table to the given file. Returns
+ * whether the file was written. A mapped table is flushed to its own file,
+ * which is never rewritten while it is mapped.
+ **/
+bool table_save(TranspositionTable* table, char *filename);
+
+/**
+ * Frees the memory the transposition table was taking up, unmapping it if it
+ * was mapped from a file.
  **/
 void table_free(TranspositionTable* table);
 
+/**
+ * Removes every entry from the transposition table, splitting the work over
+ * num_threads threads.
+ **/
+void table_clear(TranspositionTable* table, int num_threads);
+
+/**
+ * Marks the start of a new search so entries from previous searches are
+ * replaced before entries from the current one.
+ **/
+void table_new_search(TranspositionTable* table);
+
+/**
+ * Stores the result of searching the position with the given key. The entry
+ * already in the slot is only replaced if it is less valuable.
+ **/
+void table_store(TranspositionTable* table, U64 key, Move move, int score, int depth, Bound bound);
 
 /**
- * Inserts an entry into the transposition table. Returns whether it was able
- * to insert the element.
+ * Starts loading the slot of the given key into the cache, so a probe issued
+ * shortly after does not wait on memory.
  **/
-bool table_insert(TranspositionTable* table, U64 key, Move move);
+void table_prefetch(TranspositionTable* table, U64 key);
 
 /**
- * Deletes the entry with the given key from the transposition table. Returns 
- * whether it was able to delete the element.
+ * Looks up the position with the given key in the transposition table. Returns
+ * whether the key was found, in which case data is filled with its entry.
  **/
-bool table_delete(TranspositionTable* table, U64 key);
+bool table_probe(TranspositionTable* table, U64 key, EntryData *data);
 
 /**
- * Returns the move corresponding to the given key in the transposition table.
+ * Returns how full the transposition table is with entries from the current
+ * search in permill, estimated from the first thousand slots.
  **/
-Move* table_lookup(TranspositionTable* table, U64 key);
+int table_hashfull(TranspositionTable* table);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,37 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+/*
+Texel tuning of the evaluation weights.
+
+Labeled positions are read from a self-play container and resolved once with a
+captures-only quiescence search. Only the term coefficients of the quiet leaf
+and the game result are kept, so every position takes a few bytes in memory
+and evaluating it with new weights is a dot product. The weights are then fit
+with Adam to minimize the mean squared error between the game results and the
+sigmoid of the evaluation, where the sigmoid's scale is first fit to the
+current weights. Every epoch splits the positions over the threads, which
+accumulate their own gradients before they are summed.
+*/
+
+#include <stdbool.h>
+#include "defs.h"
+
+#define TUNER_EPOCHS 1000
+#define TUNER_LEARNING_RATE 0.1
+#define TUNER_QUIESCENCE_DEPTH 8
+
+typedef struct
+{
+    int num_threads;
+    int epochs;
+    double learning_rate;
+} TunerOptions;
+
+/**
+ * Tunes the evaluation weights on the records of a self-play container and
+ * prints the tuned weights. Returns false if the container could not be read.
+ **/
+bool tuner_run(char *filename, TunerOptions *options);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include "chessboard.h"
+#include "move.h"
+
+/**
+ * Writes the move in long algebraic notation (e.g. e2e4, e7e8q) into the
+ * given buffer, which must hold at least 6 characters.
+ **/
+void uci_move_to_string(Move move, char *buffer);
+
+/**
+ * Returns the legal move on the board matching the given long algebraic
+ * notation. NULL_MOVE is returned if no such move exists.
+ **/
+Move uci_parse_move(ChessBoard *board, char *move_str);
+
+/**
+ * Reads UCI commands from stdin and answers them on stdout until the quit
+ * command is received. Searches run on a separate thread so commands such as
+ * stop and isready are answered while the engine is thinking.
+ **/
+void uci_loop(void);
+
+#endif
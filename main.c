@@ -1,4 +1,267 @@
-int main(void)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chessboard.h"
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "analysis.h"
+#include "bench.h"
+#include "fen.h"
+#include "packed_position.h"
+#include "selfplay.h"
+#include "tablebase.h"
+#include "tuner.h"
+#include "trace.h"
+#include "uci.h"
+
+int main(int argc, char **argv)
 {
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+
+    // Runs a benchmark instead of the UCI loop when asked to: main (bench|perft) [depth] [counters]
+    if (argc > 1 && (strcmp(argv[1], "bench") == 0 || strcmp(argv[1], "perft") == 0))
+    {
+        // The depth may be left out, so counters can be the first argument
+        char *depth = (argc > 2) ? argv[2] : NULL;
+        bool use_counters = (argc > 2 && strcmp(argv[argc - 1], "counters") == 0);
+
+        if (strcmp(argv[1], "bench") == 0)
+            bench_run(bench_parse_depth(depth, BENCH_DEPTH), use_counters);
+        else
+            bench_perft(bench_parse_depth(depth, PERFT_DEPTH), use_counters);
+
+        return 0;
+    }
+
+    // Analyzes an EPD file: main analyze <input> <output> [workers n] [hash mb] [depth n] [nodes n] [movetime ms]
+    if (argc > 3 && strcmp(argv[1], "analyze") == 0)
+    {
+        AnalysisOptions options = {
+            .num_workers = sysconf(_SC_NPROCESSORS_ONLN),
+            .hash_size = ANALYSIS_HASH,
+        };
+
+        for (int i = 4; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "workers") == 0)
+                options.num_workers = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "hash") == 0)
+                options.hash_size = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "depth") == 0)
+                options.limits.depth = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "nodes") == 0)
+                options.limits.nodes = strtoull(argv[i + 1], NULL, 10);
+            else if (strcmp(argv[i], "movetime") == 0)
+                options.limits.move_time = atol(argv[i + 1]);
+        }
+
+        if (!options.limits.depth && !options.limits.nodes && !options.limits.move_time)
+            options.limits.depth = ANALYSIS_DEPTH;
+
+        FILE *input = fopen(argv[2], "r");
+        FILE *output = (strcmp(argv[3], "-") == 0) ? stdout : fopen(argv[3], "w");
+        if (input == NULL || output == NULL)
+        {
+            printf("Could not open %s.\n", (input == NULL) ? argv[2] : argv[3]);
+            return 1;
+        }
+
+        bool success = analysis_run(input, output, &options);
+
+        fclose(input);
+        if (output != stdout)
+            fclose(output);
+
+        if (!success)
+        {
+            printf("Could not allocate the analysis workers.\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Packs the positions of an EPD file into a container: main pack <input> <output> [raw]
+    if (argc > 3 && strcmp(argv[1], "pack") == 0)
+    {
+        FILE *input = fopen(argv[2], "r");
+        U32 flags = (argc > 4 && strcmp(argv[4], "raw") == 0) ? 0 : PACKED_COMPRESSED;
+        PackedWriter *writer = (input != NULL) ? packed_writer_open(argv[3], sizeof(PackedPosition), flags) : NULL;
+        if (writer == NULL)
+        {
+            printf("Could not open %s.\n", (input == NULL) ? argv[2] : argv[3]);
+            return 1;
+        }
+
+        static ChessBoard board;
+        char line[1000];
+        U64 num_skipped = 0;
+        while (fgets(line, sizeof(line), input) != NULL)
+        {
+            PackedPosition packed;
+            if (fen_parse(&board, line, NULL) != FEN_OK)
+                continue;
+
+            if (!packed_encode(&board, &packed))
+            {
+                num_skipped++;
+                continue;
+            }
+            packed_writer_add(writer, &packed);
+        }
+        fclose(input);
+
+        if (num_skipped > 0)
+            printf("Skipped %llu positions with more than 32 pieces.\n", (unsigned long long) num_skipped);
+
+        if (!packed_writer_close(writer))
+        {
+            printf("Could not write %s.\n", argv[3]);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Prints the positions of a container as FEN strings: main unpack <input>
+    if (argc > 2 && strcmp(argv[1], "unpack") == 0)
+    {
+        PackedReader *reader = packed_reader_open(argv[2]);
+        if (reader == NULL || reader->record_size < sizeof(PackedPosition))
+        {
+            printf("Could not open %s.\n", argv[2]);
+            return 1;
+        }
+
+        // Records start with a PackedPosition followed by any labels
+        static ChessBoard board;
+        union
+        {
+            PackedPosition packed;
+            U8 bytes[PACKED_MAX_RECORD_SIZE];
+        } record;
+        while (packed_reader_next(reader, &record))
+        {
+            char fen[FEN_MAX_LENGTH];
+            packed_decode(&record.packed, &board);
+            fen_write(&board, fen);
+            printf("%s\n", fen);
+        }
+        packed_reader_close(reader);
+
+        return 0;
+    }
+
+    // Generates training data: main selfplay <output> [games n] [threads n] [nodes n] [random n] [hash mb] [seed n]
+    if (argc > 2 && strcmp(argv[1], "selfplay") == 0)
+    {
+        SelfplayOptions options = {
+            .num_threads = sysconf(_SC_NPROCESSORS_ONLN),
+            .num_games = 100,
+            .nodes = SELFPLAY_NODES,
+            .random_plies = SELFPLAY_RANDOM_PLIES,
+            .hash_size = SELFPLAY_HASH,
+        };
+
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "games") == 0)
+                options.num_games = strtoull(argv[i + 1], NULL, 10);
+            else if (strcmp(argv[i], "threads") == 0)
+                options.num_threads = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "nodes") == 0)
+                options.nodes = strtoull(argv[i + 1], NULL, 10);
+            else if (strcmp(argv[i], "random") == 0)
+                options.random_plies = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "hash") == 0)
+                options.hash_size = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "seed") == 0)
+                options.seed = strtoull(argv[i + 1], NULL, 10);
+        }
+
+        if (!selfplay_run(argv[2], &options))
+        {
+            printf("Could not write %s.\n", argv[2]);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Tunes the evaluation weights: main tune <self-play container> [threads n] [epochs n] [rate r]
+    if (argc > 2 && strcmp(argv[1], "tune") == 0)
+    {
+        TunerOptions options = {
+            .num_threads = sysconf(_SC_NPROCESSORS_ONLN),
+            .epochs = TUNER_EPOCHS,
+            .learning_rate = TUNER_LEARNING_RATE,
+        };
+
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "threads") == 0)
+                options.num_threads = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "epochs") == 0)
+                options.epochs = atoi(argv[i + 1]);
+            else if (strcmp(argv[i], "rate") == 0)
+                options.learning_rate = atof(argv[i + 1]);
+        }
+
+        if (!tuner_run(argv[2], &options))
+        {
+            printf("Could not load self-play records from %s.\n", argv[2]);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Generates endgame tables: main tbgen <directory> <material or number of pieces>... [threads n]
+    if (argc > 3 && strcmp(argv[1], "tbgen") == 0)
+    {
+        int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int i = 3; i + 1 < argc; i++)
+        {
+            if (strcmp(argv[i], "threads") == 0)
+                num_threads = atoi(argv[i + 1]);
+        }
+
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "threads") == 0)
+            {
+                i++;
+                continue;
+            }
+
+            if (!tablebase_generate(argv[2], argv[i], num_threads))
+            {
+                printf("Could not generate %s in %s.\n", argv[i], argv[2]);
+                return 1;
+            }
+        }
+
+        tablebase_free();
+
+        return 0;
+    }
+
+    // Converts a binary search trace to Chrome's trace format: main trace2json <trace> <json>
+    if (argc > 3 && strcmp(argv[1], "trace2json") == 0)
+    {
+        if (!trace_convert(argv[2], argv[3]))
+        {
+            printf("Could not convert %s.\n", argv[2]);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    uci_loop();
+
     return 0;
-}
\ No newline at end of file
+}
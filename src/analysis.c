@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "analysis.h"
+#include "fen.h"
+#include "uci.h"
+
+#define MAX_LINE_LENGTH 512
+#define SLOTS_PER_WORKER 4
+#define EVAL_CACHE_SIZE (1 << 16)
+
+typedef struct
+{
+    char line[MAX_LINE_LENGTH];
+    bool done;
+
+    FenError error;
+    char epd[FEN_MAX_LENGTH];
+    char id[EPD_MAX_ID_LENGTH];
+    int num_half_moves;
+    int num_full_moves;
+
+    Move best_move;
+    int depth;
+    int score;
+    U64 nodes;
+    PrincipalVariation pv;
+} Slot;
+
+typedef struct
+{
+    AnalysisOptions *options;
+
+    Slot *slots;
+    U64 num_slots;
+
+    // Positions [next_write, next_claim) are being searched and [next_claim, next_read) are waiting
+    U64 next_read;
+    U64 next_claim;
+    U64 next_write;
+    bool end_of_input;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t slot_done;
+} Pool;
+
+typedef struct
+{
+    // First member so the report callback can get back to the worker from its SearchInfo
+    SearchInfo info;
+
+    ChessBoard board;
+    Pool *pool;
+    Slot *slot;
+    pthread_t thread;
+} Worker;
+
+/**
+ * Records the result of every completed iteration in the worker's slot.
+ **/
+static void record_iteration(SearchInfo *info, int depth, int line, int score, PrincipalVariation *pv)
+{
+    Slot *slot = ((Worker *) info)->slot;
+
+    slot->depth = depth;
+    slot->score = score;
+    slot->pv = *pv;
+}
+
+/**
+ * Searches the position of the worker's slot and fills in the result.
+ **/
+static void analyze_slot(Worker *worker)
+{
+    Slot *slot = worker->slot;
+    EpdRecord record;
+
+    slot->depth = 0;
+    slot->score = 0;
+    slot->nodes = 0;
+    slot->pv.size = 0;
+    slot->best_move = NULL_MOVE;
+
+    slot->error = epd_parse(&worker->board, &record, slot->line);
+    if (slot->error != FEN_OK)
+        return;
+
+    epd_write(&worker->board, slot->epd);
+    strcpy(slot->id, record.id);
+    slot->num_half_moves = worker->board.num_half_moves;
+    slot->num_full_moves = worker->board.num_full_moves;
+
+    // Clears the table so every result is independent of which worker searched it
+    table_clear(worker->info.table, 1);
+
+    worker->info.limits = worker->pool->options->limits;
+    atomic_store(&worker->info.stop, false);
+    atomic_store(&worker->info.pondering, false);
+
+    slot->best_move = search_position(&worker->info, &worker->board);
+    slot->nodes = atomic_load(&worker->info.nodes);
+}
+
+/**
+ * Entry point of the workers, which search waiting positions until the input
+ * is exhausted.
+ **/
+static void* worker_main(void *arg)
+{
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true)
+    {
+        while (pool->next_claim == pool->next_read && !pool->end_of_input)
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+
+        if (pool->next_claim == pool->next_read)
+            break;
+
+        worker->slot = &pool->slots[pool->next_claim++ % pool->num_slots];
+        pthread_mutex_unlock(&pool->mutex);
+
+        analyze_slot(worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        worker->slot->done = true;
+        pthread_cond_signal(&pool->slot_done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+/**
+ * Reads the next non-empty line of the input into the buffer, discarding the
+ * rest of lines that are too long. Returns false at the end of the input.
+ **/
+static bool read_line(FILE *input, char *line)
+{
+    while (fgets(line, MAX_LINE_LENGTH, input) != NULL)
+    {
+        int length = strcspn(line, "\r\n");
+        if (line[length] == '\0' && length == MAX_LINE_LENGTH - 1)
+        {
+            int c;
+            while ((c = fgetc(input)) != EOF && c != '\n');
+        }
+        line[length] = '\0';
+
+        if (length > 0)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Writes the result of the slot as an EPD line.
+ **/
+static void write_slot(FILE *output, Slot *slot)
+{
+    if (slot->error != FEN_OK)
+    {
+        fprintf(output, "%s; c0 \"%s\";\n", slot->line, fen_error_string(slot->error));
+        return;
+    }
+
+    fprintf(output, "%s", slot->epd);
+    if (slot->id[0] != '\0')
+        fprintf(output, " id \"%s\";", slot->id);
+
+    // The clocks are operations in EPD, not fields of the position
+    fprintf(output, " hmvc %i; fmvn %i;", slot->num_half_moves, slot->num_full_moves);
+
+    fprintf(output, " acd %i; acn %llu;", slot->depth, (unsigned long long) slot->nodes);
+
+    if (IsMateScore(slot->score))
+        fprintf(output, " dm %i;", search_mate_moves(slot->score));
+    else
+        fprintf(output, " ce %i;", search_centipawns(slot->score));
+
+    if (!IsNullMove(slot->best_move))
+    {
+        char buffer[6];
+        uci_move_to_string(slot->best_move, buffer);
+        fprintf(output, " pm %s;", buffer);
+    }
+
+    if (slot->pv.size > 0)
+    {
+        fprintf(output, " pv");
+        for (int i = 0; i < slot->pv.size; i++)
+        {
+            char buffer[6];
+            uci_move_to_string(slot->pv.moves[i], buffer);
+            fprintf(output, " %s", buffer);
+        }
+        fprintf(output, ";");
+    }
+
+    fprintf(output, "\n");
+}
+
+/**
+ * Frees the tables of the first num_workers workers and the workers themselves.
+ **/
+static void free_workers(Worker *workers, int num_workers)
+{
+    for (int i = 0; i < num_workers; i++)
+    {
+        table_free(workers[i].info.table);
+        eval_cache_free(workers[i].info.eval_cache);
+    }
+
+    free(workers);
+}
+
+/**
+ * Analyzes every position of the input file with the given options, writing the
+ * results to the output file in input order. A summary is printed to stderr.
+ * Returns false if the workers could not be allocated.
+ **/
+bool analysis_run(FILE *input, FILE *output, AnalysisOptions *options)
+{
+    int num_workers = (options->num_workers > 0) ? options->num_workers : 1;
+    int hash_size = (options->hash_size > 0) ? options->hash_size : ANALYSIS_HASH;
+
+    Pool pool = {
+        .options = options,
+        .num_slots = num_workers * SLOTS_PER_WORKER,
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .work_ready = PTHREAD_COND_INITIALIZER,
+        .slot_done = PTHREAD_COND_INITIALIZER,
+    };
+
+    pool.slots = malloc(pool.num_slots * sizeof(Slot));
+    Worker *workers = calloc(num_workers, sizeof(Worker));
+    if (pool.slots == NULL || workers == NULL)
+    {
+        free(pool.slots);
+        free(workers);
+        return false;
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        workers[i].pool = &pool;
+        workers[i].info.num_threads = 1;
+        workers[i].info.report = record_iteration;
+        workers[i].info.table = table_init((U64) hash_size * 1024 * 1024 / sizeof(Entry));
+        workers[i].info.eval_cache = eval_cache_init(EVAL_CACHE_SIZE);
+
+        if (workers[i].info.table == NULL || workers[i].info.eval_cache == NULL)
+        {
+            free_workers(workers, i + 1);
+            free(pool.slots);
+            return false;
+        }
+    }
+
+    long start_time = search_time();
+
+    for (int i = 0; i < num_workers; i++)
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+
+    U64 total_nodes = 0;
+
+    pthread_mutex_lock(&pool.mutex);
+    while (true)
+    {
+        // Fills the window, leaving the mutex while reading so workers can keep claiming positions
+        while (!pool.end_of_input && pool.next_read - pool.next_write < pool.num_slots)
+        {
+            Slot *slot = &pool.slots[pool.next_read % pool.num_slots];
+
+            pthread_mutex_unlock(&pool.mutex);
+            bool has_line = read_line(input, slot->line);
+            pthread_mutex_lock(&pool.mutex);
+
+            if (!has_line)
+            {
+                pool.end_of_input = true;
+                pthread_cond_broadcast(&pool.work_ready);
+                break;
+            }
+
+            slot->done = false;
+            pool.next_read++;
+            pthread_cond_signal(&pool.work_ready);
+        }
+
+        if (pool.next_write == pool.next_read)
+            break;
+
+        Slot *slot = &pool.slots[pool.next_write % pool.num_slots];
+        while (!slot->done)
+            pthread_cond_wait(&pool.slot_done, &pool.mutex);
+
+        pthread_mutex_unlock(&pool.mutex);
+        write_slot(output, slot);
+        total_nodes += slot->nodes;
+        pthread_mutex_lock(&pool.mutex);
+
+        pool.next_write++;
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    for (int i = 0; i < num_workers; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    fflush(output);
+
+    long time = search_time() - start_time;
+    if (time <= 0)
+        time = 1;
+
+    fprintf(stderr, "Analyzed %llu positions with %i workers in %li ms: %.1f positions/second, %llu nodes/second\n",
+        (unsigned long long) pool.next_write,
+        num_workers,
+        time,
+        pool.next_write * 1000.0 / time,
+        (unsigned long long) (total_nodes * 1000 / time));
+
+    free_workers(workers, num_workers);
+    free(pool.slots);
+
+    return true;
+}
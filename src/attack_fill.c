@@ -0,0 +1,146 @@
+#include "lookup_tables.h"
+#include "attack_fill.h"
+
+#if defined(__x86_64__) && !defined(DISABLE_SIMD)
+#define USE_VECTOR_FILL
+#endif
+
+#define NOT_FILE_A 0xfefefefefefefefeULL
+#define NOT_FILE_H 0x7f7f7f7f7f7f7f7fULL
+
+#ifdef USE_VECTOR_FILL
+
+typedef U64 U64x4 __attribute__((vector_size(32)));
+
+/**
+ * Returns the squares attacked by all the given sliders, filling the north,
+ * east, north east and north west rays in the lanes of one vector and the
+ * south, west, south west and south east rays in another. Compiled for AVX2,
+ * where the lanes shift by their own amounts, and for any other processor.
+ **/
+__attribute__((target_clones("avx2", "default")))
+BitBoard attack_fill_sliders(BitBoard orthogonal, BitBoard diagonal, BitBoard occupied)
+{
+    BitBoard empty = ~occupied;
+
+    // Lanes hold the north/south, east/west, north east/south west and north west/south east rays
+    const U64x4 shift = {8, 1, 9, 7};
+    const U64x4 left_mask = {~0ULL, NOT_FILE_A, NOT_FILE_A, NOT_FILE_H};
+    const U64x4 right_mask = {~0ULL, NOT_FILE_H, NOT_FILE_H, NOT_FILE_A};
+
+    U64x4 left = {orthogonal, orthogonal, diagonal, diagonal};
+    U64x4 right = left;
+    U64x4 left_empty = empty & left_mask;
+    U64x4 right_empty = empty & right_mask;
+
+    // Doubles the distance covered with each step, stopping at the first occupied square
+    left |= left_empty & (left << shift);
+    right |= right_empty & (right >> shift);
+    left_empty &= left_empty << shift;
+    right_empty &= right_empty >> shift;
+    left |= left_empty & (left << (shift * 2));
+    right |= right_empty & (right >> (shift * 2));
+    left_empty &= left_empty << (shift * 2);
+    right_empty &= right_empty >> (shift * 2);
+    left |= left_empty & (left << (shift * 4));
+    right |= right_empty & (right >> (shift * 4));
+
+    // The attacks are one step beyond the filled squares, which may be occupied
+    U64x4 attacks = ((left << shift) & left_mask) | ((right >> shift) & right_mask);
+
+    return attacks[0] | attacks[1] | attacks[2] | attacks[3];
+}
+
+#else
+
+/**
+ * Returns the squares attacked along the ray that shifts left by the given
+ * amount, with the mask clearing the squares wrapped around the board.
+ **/
+static inline BitBoard fill_left(BitBoard sliders, BitBoard empty, int shift, BitBoard mask)
+{
+    empty &= mask;
+    sliders |= empty & (sliders << shift);
+    empty &= empty << shift;
+    sliders |= empty & (sliders << (shift * 2));
+    empty &= empty << (shift * 2);
+    sliders |= empty & (sliders << (shift * 4));
+
+    return (sliders << shift) & mask;
+}
+
+/**
+ * Returns the squares attacked along the ray that shifts right by the given
+ * amount, with the mask clearing the squares wrapped around the board.
+ **/
+static inline BitBoard fill_right(BitBoard sliders, BitBoard empty, int shift, BitBoard mask)
+{
+    empty &= mask;
+    sliders |= empty & (sliders >> shift);
+    empty &= empty >> shift;
+    sliders |= empty & (sliders >> (shift * 2));
+    empty &= empty >> (shift * 2);
+    sliders |= empty & (sliders >> (shift * 4));
+
+    return (sliders >> shift) & mask;
+}
+
+/**
+ * Returns the squares attacked by all the given sliders, filling one ray at a
+ * time.
+ **/
+BitBoard attack_fill_sliders(BitBoard orthogonal, BitBoard diagonal, BitBoard occupied)
+{
+    BitBoard empty = ~occupied;
+
+    return fill_left(orthogonal, empty, 8, ~0ULL)
+        | fill_right(orthogonal, empty, 8, ~0ULL)
+        | fill_left(orthogonal, empty, 1, NOT_FILE_A)
+        | fill_right(orthogonal, empty, 1, NOT_FILE_H)
+        | fill_left(diagonal, empty, 9, NOT_FILE_A)
+        | fill_right(diagonal, empty, 9, NOT_FILE_H)
+        | fill_left(diagonal, empty, 7, NOT_FILE_H)
+        | fill_right(diagonal, empty, 7, NOT_FILE_A);
+}
+
+#endif
+
+/**
+ * Returns the squares attacked by all the given knights.
+ **/
+BitBoard attack_fill_knights(BitBoard knights)
+{
+    BitBoard one_file = ((knights << 1) & CLEAR_FILE[FILE_A]) | ((knights >> 1) & CLEAR_FILE[FILE_H]);
+    BitBoard two_files = ((knights << 2) & CLEAR_FILE_AB) | ((knights >> 2) & CLEAR_FILE_GH);
+
+    return (one_file << 16) | (one_file >> 16) | (two_files << 8) | (two_files >> 8);
+}
+
+/**
+ * Returns the squares attacked by all the given pawns of the given color.
+ **/
+BitBoard attack_fill_pawns(BitBoard pawns, int color)
+{
+    if (color == WHITE)
+        return ((pawns & CLEAR_FILE[FILE_A]) << 7) | ((pawns & CLEAR_FILE[FILE_H]) << 9);
+    else
+        return ((pawns & CLEAR_FILE[FILE_A]) >> 9) | ((pawns & CLEAR_FILE[FILE_H]) >> 7);
+}
+
+/**
+ * Returns every square attacked by the given color when the given squares are
+ * occupied.
+ **/
+BitBoard attack_fill_side(ChessBoard *board, int color, BitBoard occupied)
+{
+    // Shift to change piece color from white to black
+    const int color_shift = (color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS);
+
+    BitBoard diagonal = board->pieces[WHITE_BISHOPS + color_shift] | board->pieces[WHITE_QUEENS + color_shift];
+    BitBoard orthogonal = board->pieces[WHITE_ROOKS + color_shift] | board->pieces[WHITE_QUEENS + color_shift];
+
+    return attack_fill_sliders(orthogonal, diagonal, occupied)
+        | attack_fill_knights(board->pieces[WHITE_KNIGHTS + color_shift])
+        | attack_fill_pawns(board->pieces[WHITE_PAWNS + color_shift], color)
+        | MASK_KING_ATTACKS[bitboard_scan_forward(board->pieces[WHITE_KING + color_shift])];
+}
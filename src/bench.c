@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "search.h"
+#include "perf_counters.h"
+#include "stats.h"
+
+#define BENCH_HASH_SIZE (1 << 20)
+#define BENCH_EVAL_CACHE_SIZE (1 << 18)
+
+/*
+The first positions are taken from tests/data/perftsuite.epd and cover castling,
+en passent and promotions. The rest are middlegame positions with the material
+and mobility of a real game.
+*/
+static char *BENCH_POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "4k3/8/8/8/8/8/8/4K2R w K - 0 1",
+    "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "1k6/1b6/8/8/7R/8/8/4K2R b K - 0 1",
+    "8/1k6/8/5N2/8/4n3/8/2K5 w - - 0 1",
+    "8/P1k5/K7/8/8/8/8/8 w - - 0 1",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+};
+
+#define NUM_BENCH_POSITIONS (sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]))
+
+/**
+ * Returns the depth at the start of the given argument, or the given default
+ * if the argument is missing, does not start with a number or is not between
+ * one and MAX_PLY.
+ **/
+int bench_parse_depth(const char *arg, int default_depth)
+{
+    if (arg == NULL)
+        return default_depth;
+
+    char *end;
+    long depth = strtol(arg, &end, 10);
+
+    return (end == arg || depth <= 0 || depth > MAX_PLY) ? default_depth : (int) depth;
+}
+
+/**
+ * Searches every bench position to the given depth on a single thread with a
+ * freshly cleared transposition table, printing the total number of nodes
+ * searched and the nodes per second. Returns the total number of nodes, which
+ * only changes when the behaviour of the search changes. If use_counters is set
+ * the hardware performance counters of every search are reported per node.
+ **/
+U64 bench_run(int depth, bool use_counters)
+{
+    static ChessBoard board;
+    static SearchInfo info;
+
+    info.table = table_init(BENCH_HASH_SIZE);
+    info.eval_cache = eval_cache_init(BENCH_EVAL_CACHE_SIZE);
+    info.num_threads = 1;
+    info.report = NULL;
+
+    if (info.table == NULL || info.eval_cache == NULL)
+    {
+        printf("Could not allocate bench tables.\n");
+        table_free(info.table);
+        eval_cache_free(info.eval_cache);
+        return 0;
+    }
+
+    PerfCounters counters;
+    if (use_counters && !perf_counters_open(&counters))
+        printf("Hardware performance counters are not available.\n");
+
+    U64 total_nodes = 0;
+    long start_time = search_time();
+
+    for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
+    {
+        chessboard_init(&board, BENCH_POSITIONS[i]);
+        table_clear(info.table, info.num_threads);
+        eval_cache_clear(info.eval_cache);
+
+        info.limits = (SearchLimits) {.depth = depth};
+        atomic_store(&info.stop, false);
+        atomic_store(&info.pondering, false);
+
+        if (use_counters)
+            perf_counters_start(&counters);
+
+        search_position(&info, &board);
+
+        if (use_counters)
+            perf_counters_stop(&counters);
+
+        U64 nodes = atomic_load(&info.nodes);
+        total_nodes += nodes;
+
+        printf("Position %2i/%i: %llu nodes\n", i + 1, (int) NUM_BENCH_POSITIONS, (unsigned long long) nodes);
+    }
+
+    long time = search_time() - start_time;
+
+    printf("===========================\n");
+    printf("Total time (ms) : %li\n", time);
+    printf("Nodes searched  : %llu\n", (unsigned long long) total_nodes);
+    printf("Nodes/second    : %llu\n", (unsigned long long) (total_nodes * 1000 / (time > 0 ? time : 1)));
+
+    if (use_counters)
+    {
+        perf_counters_print(&counters, "search_position", total_nodes);
+        perf_counters_close(&counters);
+    }
+    fflush(stdout);
+
+    StatsDump();
+
+    table_free(info.table);
+    eval_cache_free(info.eval_cache);
+
+    return total_nodes;
+}
+
+/**
+ * Runs perft to the given depth on every bench position, printing the total
+ * number of leaf nodes and the nodes per second. If use_counters is set the
+ * hardware performance counters of the move generation are reported per node.
+ **/
+U64 bench_perft(int depth, bool use_counters)
+{
+    static ChessBoard board;
+
+    PerfCounters counters;
+    if (use_counters && !perf_counters_open(&counters))
+        printf("Hardware performance counters are not available.\n");
+
+    U64 total_nodes = 0;
+    long start_time = search_time();
+
+    for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
+    {
+        chessboard_init(&board, BENCH_POSITIONS[i]);
+
+        if (use_counters)
+            perf_counters_start(&counters);
+
+        U64 nodes = chessboard_perft(&board, depth);
+
+        if (use_counters)
+            perf_counters_stop(&counters);
+
+        total_nodes += nodes;
+
+        printf("Position %2i/%i: %llu nodes\n", i + 1, (int) NUM_BENCH_POSITIONS, (unsigned long long) nodes);
+    }
+
+    long time = search_time() - start_time;
+
+    printf("===========================\n");
+    printf("Total time (ms) : %li\n", time);
+    printf("Nodes searched  : %llu\n", (unsigned long long) total_nodes);
+    printf("Nodes/second    : %llu\n", (unsigned long long) (total_nodes * 1000 / (time > 0 ? time : 1)));
+
+    if (use_counters)
+    {
+        perf_counters_print(&counters, "chessboard_perft", total_nodes);
+        perf_counters_close(&counters);
+    }
+    fflush(stdout);
+
+    StatsDump();
+
+    return total_nodes;
+}
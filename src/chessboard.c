@@ -5,85 +5,23 @@
 #include <ctype.h>
 #include <math.h>
 #include "chessboard.h"
+#include "attack_fill.h"
+#include "fen.h"
 #include "lookup_tables.h"
 #include "magic_bitboard.h"
+#include "stats.h"
+
+// Marks a function taking the color as a constant, so every call with WHITE or
+// BLACK is inlined into straight-line code for that color
+#define ColorSpecialized static inline __attribute__((always_inline))
 
 /**
- * Initializes a chessboard's pieces with a fen stirng.
+ * Initializes a chessboard's pieces with a fen stirng. Use fen_parse to
+ * detect malformed strings.
  **/
 void chessboard_init(ChessBoard *board, char *fen_str)
 {
-    // Clears board
-    memset(board, 0, sizeof(ChessBoard));
-
-    // Copies fen_str into a local variables to avoid modifing it through strtok
-    char fen_cpy[100];
-    strncpy(fen_cpy, fen_str, sizeof(fen_cpy));
-
-    // Parses pieces in fen string
-    char *token = strtok(fen_cpy, " ");
-    for (int i = 0, rank = RANK_8, file = FILE_A; token[i] != '\0'; i++)
-    {
-        if (token[i] == '/')
-        {
-            rank--;
-            file = FILE_A;
-        }
-        else if (isdigit(token[i]))
-        {
-            file += token[i] - '0';
-        }
-        else
-        {
-            // Places the piece on the board
-            Piece piece_type = fen_to_piece(token[i]);
-            Piece piece_color = PieceColor(piece_type);
-
-            board->pieces[piece_type] |= FileRankToSquare(file, rank);
-            board->pieces[piece_color] |= FileRankToSquare(file, rank);
-            file++;
-        }
-    }
-
-    // Parses current player in fen string
-    token = strtok(NULL, " ");
-    board->current_color = (token[0] == 'w') ? WHITE : BLACK;
-    
-    // Parses castling permission in fen string
-    token = strtok(NULL, " ");
-    for (int i = 0; token[0] != '-' && token[i] != '\0'; i++) 
-    {
-        switch (token[i])
-        {
-            case 'K':
-                board->castle_permission |= WHITE_KING_SIDE;
-                break;
-            case 'Q':
-                board->castle_permission |= WHITE_QUEEN_SIDE;
-                break;
-            case 'k':
-                board->castle_permission |= BLACK_KING_SIDE;
-                break;
-            case 'q':
-                board->castle_permission |= BLACK_QUEEN_SIDE;
-                break;
-        }
-    }
-
-    // Parses en passent square
-    token = strtok(NULL, " ");
-    if (token[0] != '-') 
-        board->en_passent |= FileRankToSquare(token[0] - 'a', token[1] - '1');
-
-    // Parses full and half move clock
-    token = strtok(NULL, " ");
-    board->num_half_moves = atoi(token);
-    token = strtok(NULL, " ");
-    board->num_full_moves = atoi(token);
-
-    board->position_key = chessboard_hash(board);
-    board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
-    board->empty_squares = ~board->occupied_squares;
+    fen_parse(board, fen_str, NULL);
 }
 
 /**
@@ -100,9 +38,9 @@ static U64 generate_rand_number()
     return random_number;
 }
 
-static U64 PIECE_KEYS[12][64];
-static U64 CASTLE_KEYS[16]; 
-static U64 SIDE_KEY[2];
+U64 PIECE_KEYS[12][64];
+U64 CASTLE_KEYS[16];
+U64 SIDE_KEY[2];
 
 /**
  * Initializes the keys used to hash a chessboard.
@@ -170,362 +108,921 @@ Piece chessboard_get_piece(ChessBoard *board, BitBoard square_mask)
 }
 
 /**
- * Returns whether the given square is being attacked by an opponent
- * piece.
+ * Returns whether the given square is being attacked by a piece of the side
+ * that is not color.
  **/
-bool chessboard_squared_attacked(ChessBoard *board, int target)
+ColorSpecialized bool square_attacked(ChessBoard *board, int target, const int color)
 {
-    // Shift to change piece color from white to black
-    int color_shift = (board->current_color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS); 
+    // Shift from white pieces to the opponent's pieces
+    const int opponent_shift = (color == WHITE) ? BLACK_PAWNS - WHITE_PAWNS : 0;
 
     // Checks if an opponent pawn, knight, king, bishop, rook, or queen can attack the given square
-    if (MASK_PAWN_ATTACKS[board->current_color][target] & board->pieces[BLACK_PAWNS - color_shift])
+    if (MASK_PAWN_ATTACKS[color][target] & board->pieces[WHITE_PAWNS + opponent_shift])
         return true;
-    if (MASK_KNIGHT_ATTACKS[target] & board->pieces[BLACK_KNIGHTS - color_shift])
+    if (MASK_KNIGHT_ATTACKS[target] & board->pieces[WHITE_KNIGHTS + opponent_shift])
         return true;
-    if (MASK_KING_ATTACKS[target] & board->pieces[BLACK_KING - color_shift])
+    if (MASK_KING_ATTACKS[target] & board->pieces[WHITE_KING + opponent_shift])
         return true;
-    if (lookup_bishop_attacks(target, board->occupied_squares) & (board->pieces[BLACK_QUEENS - color_shift] | board->pieces[BLACK_BISHOPS - color_shift]))
+    if (lookup_bishop_attacks(target, board->occupied_squares) & (board->pieces[WHITE_QUEENS + opponent_shift] | board->pieces[WHITE_BISHOPS + opponent_shift]))
         return true;
-    if (lookup_rook_attacks(target, board->occupied_squares) & (board->pieces[BLACK_QUEENS - color_shift] | board->pieces[BLACK_ROOKS - color_shift]))
+    if (lookup_rook_attacks(target, board->occupied_squares) & (board->pieces[WHITE_QUEENS + opponent_shift] | board->pieces[WHITE_ROOKS + opponent_shift]))
         return true;
 
     return false;
 }
 
 /**
- * Updates the chessboard's pieces after a piece is moved.
+ * Returns whether the given square is being attacked by an opponent
+ * piece.
  **/
-void chessboard_move_piece(ChessBoard *board, Move move)
+bool chessboard_squared_attacked(ChessBoard *board, int target)
+{
+    return (board->current_color == WHITE)
+        ? square_attacked(board, target, WHITE)
+        : square_attacked(board, target, BLACK);
+}
+
+/**
+ * Updates the pieces after the given piece of the given color is moved,
+ * capturing the given piece.
+ **/
+ColorSpecialized void move_piece(ChessBoard *board, Move move, const int piece, const int captured, const int color)
 {
     // Shift to change piece color from white to black
-    int color_shift = (board->current_color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS); 
+    const int color_shift = (color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS);
+
+    const int origin = MoveOrigin(move), target = MoveTarget(move);
 
     // Updates the new position of the piece
-    switch (move.move_type)
+    switch (MoveType(move))
     {
         case ROOK_PROMOTION:
-            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[move.target];
+            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[target];
             break;
         case KNIGHT_PROMOTION:
-            board->pieces[WHITE_KNIGHTS + color_shift] ^= MASK_SQUARE[move.target];
+            board->pieces[WHITE_KNIGHTS + color_shift] ^= MASK_SQUARE[target];
             break;
         case BISHOP_PROMOTION:
-            board->pieces[WHITE_BISHOPS + color_shift] ^= MASK_SQUARE[move.target];
+            board->pieces[WHITE_BISHOPS + color_shift] ^= MASK_SQUARE[target];
             break;
         case QUEEN_PROMOTION:
-            board->pieces[WHITE_QUEENS + color_shift] ^= MASK_SQUARE[move.target];
+            board->pieces[WHITE_QUEENS + color_shift] ^= MASK_SQUARE[target];
             break;
         case KING_CASTLE:
-            board->pieces[move.piece] ^= MASK_SQUARE[move.target];
-            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[move.target + 1] | MASK_SQUARE[move.target - 1];
-            board->pieces[board->current_color] ^= MASK_SQUARE[move.target + 1] | MASK_SQUARE[move.target - 1];
+            board->pieces[piece] ^= MASK_SQUARE[target];
+            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[target + 1] | MASK_SQUARE[target - 1];
+            board->pieces[color] ^= MASK_SQUARE[target + 1] | MASK_SQUARE[target - 1];
             break;
         case QUEEN_CASTLE:
-            board->pieces[move.piece] ^= MASK_SQUARE[move.target];
-            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[move.target - 2] | MASK_SQUARE[move.target + 1];
-            board->pieces[board->current_color] ^= MASK_SQUARE[move.target - 2] | MASK_SQUARE[move.target + 1];
+            board->pieces[piece] ^= MASK_SQUARE[target];
+            board->pieces[WHITE_ROOKS + color_shift] ^= MASK_SQUARE[target - 2] | MASK_SQUARE[target + 1];
+            board->pieces[color] ^= MASK_SQUARE[target - 2] | MASK_SQUARE[target + 1];
             break;
         case EN_PASSENT:
-            board->pieces[move.piece] ^= MASK_SQUARE[move.target];
-            board->pieces[move.captured_piece] ^= MASK_SQUARE[move.target + 8 * ((board->current_color == WHITE) ? -1 : 1)];
-            board->pieces[!board->current_color] ^= MASK_SQUARE[move.target + 8 * ((board->current_color == WHITE) ? -1 : 1)];
+            board->pieces[piece] ^= MASK_SQUARE[target];
+            board->pieces[captured] ^= MASK_SQUARE[target + ((color == WHITE) ? -8 : 8)];
+            board->pieces[color ^ 1] ^= MASK_SQUARE[target + ((color == WHITE) ? -8 : 8)];
             break;
         default:
-            board->pieces[move.piece] ^= MASK_SQUARE[move.target];
+            board->pieces[piece] ^= MASK_SQUARE[target];
             break;
     }
 
-    board->pieces[move.piece] ^= MASK_SQUARE[move.origin];
-    board->pieces[board->current_color] ^= MASK_SQUARE[move.origin] | MASK_SQUARE[move.target];
+    board->pieces[piece] ^= MASK_SQUARE[origin];
+    board->pieces[color] ^= MASK_SQUARE[origin] | MASK_SQUARE[target];
     
-    if (move.captured_piece != EMPTY && move.move_type != EN_PASSENT)
+    if (captured != EMPTY && MoveType(move) != EN_PASSENT)
     {
-        board->pieces[move.captured_piece] ^= MASK_SQUARE[move.target];
-        board->pieces[!board->current_color] ^= MASK_SQUARE[move.target];
+        board->pieces[captured] ^= MASK_SQUARE[target];
+        board->pieces[color ^ 1] ^= MASK_SQUARE[target];
     }
 
     board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
     board->empty_squares = ~board->occupied_squares;
 }
 
+/**
+ * Returns whether the current position occured before since the last capture
+ * or pawn move.
+ **/
+bool chessboard_is_repetition(ChessBoard *board)
+{
+    if (board->repetition_filter[RepetitionSlot(board->position_key)] == 0)
+        return false;
+
+    // Only positions with the same side to move can repeat, the closest being four plies ago
+    int first = board->num_moves - board->num_half_moves;
+    for (int i = board->num_moves - 4; i >= 0 && i >= first; i -= 2)
+    {
+        if (board->move_history[i].position_key == board->position_key)
+            return true;
+    }
+
+    return false;
+}
 
 /**
- * Updates the chessboard's pieces after the given pseudo legal move is played. 
- * Returns whether the move is legal. If the move is not legal the board is not
- * updated.
+ * Returns whether the game is drawn by repetition or the fifty move rule.
  **/
-bool chessboard_make_move(ChessBoard *board, Move move)
+bool chessboard_is_draw(ChessBoard *board)
 {
-    board->move_history[board->num_moves].move = move;
-    board->move_history[board->num_moves].position_key = board->position_key;
-    board->move_history[board->num_moves].castle_permission = board->castle_permission;
-    board->move_history[board->num_moves].en_passent_target = bitboard_pop(&board->en_passent);
-    board->num_moves++;
+    return board->num_half_moves >= 100 || chessboard_is_repetition(board);
+}
 
+/**
+ * Returns the piece of the given color on the origin square, which must hold
+ * one.
+ **/
+ColorSpecialized Piece moved_piece(ChessBoard *board, int origin, const int color)
+{
     // Shift to change piece color from white to black
-    int color_shift = (board->current_color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS); 
+    const int color_shift = (color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS);
 
-    chessboard_move_piece(board, move);
+    for (int piece = WHITE_PAWNS + color_shift; piece < WHITE_KING + color_shift; piece++)
+    {
+        if (board->pieces[piece] & MASK_SQUARE[origin])
+            return piece;
+    }
 
-    // Invalid move if king is being attacked
-    if (chessboard_squared_attacked(board, bitboard_scan_forward(board->pieces[WHITE_KING + color_shift])))
+    return WHITE_KING + color_shift;
+}
+
+/**
+ * Returns the opponent piece of the given color on the target square, which
+ * must not hold a piece of the given color.
+ **/
+ColorSpecialized Piece captured_piece(ChessBoard *board, int target, const int color)
+{
+    // Shift from white pieces to the opponent's pieces
+    const int opponent_shift = (color == WHITE) ? BLACK_PAWNS - WHITE_PAWNS : 0;
+
+    if (!(board->pieces[color ^ 1] & MASK_SQUARE[target]))
+        return EMPTY;
+
+    for (int piece = WHITE_PAWNS + opponent_shift; piece < WHITE_KING + opponent_shift; piece++)
     {
-        chessboard_undo_move(board);
-        return false;
+        if (board->pieces[piece] & MASK_SQUARE[target])
+            return piece;
     }
 
-    board->en_passent = 0;
-    board->position_key = chessboard_hash(board);
-    board->current_color = !board->current_color;
+    return WHITE_KING + opponent_shift;
+}
+
+/**
+ * Returns the piece the given color captures with the move, including the pawn
+ * taken en passent.
+ **/
+ColorSpecialized Piece move_captured_piece(ChessBoard *board, Move move, const int color)
+{
+    if (MoveType(move) == EN_PASSENT)
+        return (color == WHITE) ? BLACK_PAWNS : WHITE_PAWNS;
+
+    return captured_piece(board, MoveTarget(move), color);
+}
+
+/**
+ * Returns the piece moved by the given move, which has not been played yet.
+ **/
+Piece chessboard_moved_piece(ChessBoard *board, Move move)
+{
+    return (board->current_color == WHITE)
+        ? moved_piece(board, MoveOrigin(move), WHITE)
+        : moved_piece(board, MoveOrigin(move), BLACK);
+}
+
+/**
+ * Returns the piece captured by the given move, which has not been played
+ * yet, or EMPTY if the move is not a capture.
+ **/
+Piece chessboard_captured_piece(ChessBoard *board, Move move)
+{
+    return (board->current_color == WHITE)
+        ? move_captured_piece(board, move, WHITE)
+        : move_captured_piece(board, move, BLACK);
+}
+
+/**
+ * Updates the chessboard's pieces after a piece is moved.
+ **/
+void chessboard_move_piece(ChessBoard *board, Move move)
+{
+    if (board->current_color == WHITE)
+        move_piece(board, move, moved_piece(board, MoveOrigin(move), WHITE), move_captured_piece(board, move, WHITE), WHITE);
+    else
+        move_piece(board, move, moved_piece(board, MoveOrigin(move), BLACK), move_captured_piece(board, move, BLACK), BLACK);
+}
+
+/**
+ * Returns the castling permissions left after the move is played.
+ **/
+static int castle_permission_after(int castle_permission, Move move, int piece, int captured)
+{
+    const int origin = MoveOrigin(move), target = MoveTarget(move);
 
     // Removes castling permission if a king or rook moves
-    switch (move.piece)
+    switch (piece)
     {
         case WHITE_ROOKS: 
-            if (move.origin == A1 || move.target == A1)
-                board->castle_permission &= ~WHITE_QUEEN_SIDE;
-            else if (move.origin == H1 || move.target == H1)
-                board->castle_permission &= ~WHITE_KING_SIDE;
+            if (origin == A1 || target == A1)
+                castle_permission &= ~WHITE_QUEEN_SIDE;
+            else if (origin == H1 || target == H1)
+                castle_permission &= ~WHITE_KING_SIDE;
             break;
         case BLACK_ROOKS:
-            if (move.origin == A8 || move.target == A8)
-                board->castle_permission &= ~BLACK_QUEEN_SIDE;
-            else if (move.origin == H8 || move.target == H8)
-                board->castle_permission &= ~BLACK_KING_SIDE;
+            if (origin == A8 || target == A8)
+                castle_permission &= ~BLACK_QUEEN_SIDE;
+            else if (origin == H8 || target == H8)
+                castle_permission &= ~BLACK_KING_SIDE;
             break;
         case WHITE_KING:
-            board->castle_permission &= ~WHITE_KING_SIDE;
-            board->castle_permission &= ~WHITE_QUEEN_SIDE;
+            castle_permission &= ~(WHITE_KING_SIDE | WHITE_QUEEN_SIDE);
             break;
         case BLACK_KING:
-            board->castle_permission &= ~BLACK_KING_SIDE;
-            board->castle_permission &= ~BLACK_QUEEN_SIDE;
-            break;
-        case WHITE_PAWNS:
-            if (move.target - move.origin == 16)
-                board->en_passent = MASK_SQUARE[move.target - 8];
-            break;
-        case BLACK_PAWNS:
-            if (move.target - move.origin == -16)
-                board->en_passent = MASK_SQUARE[move.target + 8];
+            castle_permission &= ~(BLACK_KING_SIDE | BLACK_QUEEN_SIDE);
             break;
     }
-    
+
     // Removes castling rights if one of the rooks gets captured
-    switch (move.captured_piece)
+    switch (captured)
     {
         case WHITE_ROOKS: 
-            if (move.target == A1)
-                board->castle_permission &= ~WHITE_QUEEN_SIDE;
-            else if (move.target == H1)
-                board->castle_permission &= ~WHITE_KING_SIDE;
+            if (target == A1)
+                castle_permission &= ~WHITE_QUEEN_SIDE;
+            else if (target == H1)
+                castle_permission &= ~WHITE_KING_SIDE;
             break;
         case BLACK_ROOKS:
-            if (move.target == A8)
-                board->castle_permission &= ~BLACK_QUEEN_SIDE;
-            else if (move.target == H8)
-                board->castle_permission &= ~BLACK_KING_SIDE;
+            if (target == A8)
+                castle_permission &= ~BLACK_QUEEN_SIDE;
+            else if (target == H8)
+                castle_permission &= ~BLACK_KING_SIDE;
             break;
     }
 
-    return true;
+    return castle_permission;
 }
 
 /**
- * Updates the chessboard's pieces after undoing the last moved played.
+ * Returns the position key after the given color plays the move, moving the
+ * given piece and capturing the other.
  **/
-void chessboard_undo_move(ChessBoard *board)
+ColorSpecialized U64 key_after(ChessBoard *board, Move move, const int piece, const int captured, const int color)
+{
+    // Shift from white pieces to the moving side's pieces, minus WHITE_PAWNS to index PIECE_KEYS
+    const int key_shift = ((color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS)) - WHITE_PAWNS;
+
+    const int origin = MoveOrigin(move), target = MoveTarget(move);
+
+    U64 key = board->position_key ^ SIDE_KEY[WHITE] ^ SIDE_KEY[BLACK];
+    key ^= CASTLE_KEYS[board->castle_permission] ^ CASTLE_KEYS[castle_permission_after(board->castle_permission, move, piece, captured)];
+    key ^= PIECE_KEYS[piece - WHITE_PAWNS][origin];
+
+    switch (MoveType(move))
+    {
+        case ROOK_PROMOTION:
+            key ^= PIECE_KEYS[WHITE_ROOKS + key_shift][target];
+            break;
+        case KNIGHT_PROMOTION:
+            key ^= PIECE_KEYS[WHITE_KNIGHTS + key_shift][target];
+            break;
+        case BISHOP_PROMOTION:
+            key ^= PIECE_KEYS[WHITE_BISHOPS + key_shift][target];
+            break;
+        case QUEEN_PROMOTION:
+            key ^= PIECE_KEYS[WHITE_QUEENS + key_shift][target];
+            break;
+        case KING_CASTLE:
+            key ^= PIECE_KEYS[piece - WHITE_PAWNS][target];
+            key ^= PIECE_KEYS[WHITE_ROOKS + key_shift][target + 1];
+            key ^= PIECE_KEYS[WHITE_ROOKS + key_shift][target - 1];
+            break;
+        case QUEEN_CASTLE:
+            key ^= PIECE_KEYS[piece - WHITE_PAWNS][target];
+            key ^= PIECE_KEYS[WHITE_ROOKS + key_shift][target - 2];
+            key ^= PIECE_KEYS[WHITE_ROOKS + key_shift][target + 1];
+            break;
+        case EN_PASSENT:
+            key ^= PIECE_KEYS[piece - WHITE_PAWNS][target];
+            key ^= PIECE_KEYS[captured - WHITE_PAWNS][target + ((color == WHITE) ? -8 : 8)];
+            break;
+        default:
+            key ^= PIECE_KEYS[piece - WHITE_PAWNS][target];
+            break;
+    }
+
+    if (captured != EMPTY && MoveType(move) != EN_PASSENT)
+        key ^= PIECE_KEYS[captured - WHITE_PAWNS][target];
+
+    return key;
+}
+
+/**
+ * Returns the position key the board will have after the given pseudo legal
+ * move is played, updating the current key with only the squares the move
+ * changes.
+ **/
+U64 chessboard_key_after(ChessBoard *board, Move move)
+{
+    return (board->current_color == WHITE)
+        ? key_after(board, move, moved_piece(board, MoveOrigin(move), WHITE), move_captured_piece(board, move, WHITE), WHITE)
+        : key_after(board, move, moved_piece(board, MoveOrigin(move), BLACK), move_captured_piece(board, move, BLACK), BLACK);
+}
+
+/**
+ * Undoes the last move, which was played by the given color.
+ **/
+ColorSpecialized void undo_move(ChessBoard *board, const int color)
 {
     MoveInfo move_info = board->move_history[--board->num_moves];
-    board->current_color = PieceColor(move_info.move.piece);
+    board->current_color = color;
 
-    chessboard_move_piece(board, move_info.move);
+    move_piece(board, move_info.move, move_info.piece, move_info.captured_piece, color);
 
     board->position_key = move_info.position_key;
     board->castle_permission = move_info.castle_permission;
-    board->en_passent = (move_info.en_passent_target != -1) 
+    board->num_half_moves = move_info.num_half_moves;
+    board->num_full_moves = move_info.num_full_moves;
+    board->repetition_filter[RepetitionSlot(move_info.position_key)]--;
+    board->en_passent = (move_info.en_passent_target != (U8) -1) 
         ? MASK_SQUARE[move_info.en_passent_target]
         : 0;
 }
 
 /**
- * Appends each move in the move_mask to the given MoveList.
+ * Saves what undoing the move needs to restore into the move history.
+ **/
+ColorSpecialized void record_move(ChessBoard *board, Move move, const int piece, const int captured)
+{
+    board->move_history[board->num_moves].move = move;
+    board->move_history[board->num_moves].piece = piece;
+    board->move_history[board->num_moves].captured_piece = captured;
+    board->move_history[board->num_moves].position_key = board->position_key;
+    board->move_history[board->num_moves].castle_permission = board->castle_permission;
+    board->move_history[board->num_moves].en_passent_target = bitboard_pop(&board->en_passent);
+    board->move_history[board->num_moves].num_half_moves = board->num_half_moves;
+    board->move_history[board->num_moves].num_full_moves = board->num_full_moves;
+    board->repetition_filter[RepetitionSlot(board->position_key)]++;
+    board->num_moves++;
+}
+
+/**
+ * Updates everything but the pieces after the given color played the move. The
+ * key is computed from the move unless the caller already computed it.
+ **/
+ColorSpecialized void finish_move(ChessBoard *board, Move move, const int piece, const int captured, const U64 *key, const int color)
+{
+    // Updates the key before the side to move and castling rights it starts from
+    board->position_key = (key != NULL) ? *key : key_after(board, move, piece, captured, color);
+    board->en_passent = 0;
+    board->current_color = color ^ 1;
+    board->castle_permission = castle_permission_after(board->castle_permission, move, piece, captured);
+
+    // Captures and pawn moves reset the clock of the fifty move rule
+    const int pawn = (color == WHITE) ? WHITE_PAWNS : BLACK_PAWNS;
+    board->num_half_moves = (captured != EMPTY || piece == pawn) ? 0 : board->num_half_moves + 1;
+    if (color == BLACK)
+        board->num_full_moves++;
+
+    // Allows the pawn that just moved two squares to be captured en passent
+    if (piece == pawn && MoveTarget(move) - MoveOrigin(move) == ((color == WHITE) ? 16 : -16))
+        board->en_passent = MASK_SQUARE[MoveTarget(move) + ((color == WHITE) ? -8 : 8)];
+}
+
+/**
+ * Plays the pseudo legal move of the given color, the side to move, with the
+ * key it leads to if known. Returns whether the move is legal, otherwise the
+ * board is left unchanged.
  **/
-static void append_moves(ChessBoard *board, MoveList *list, BitBoard *move_mask, int origin, int piece)
+ColorSpecialized bool make_move(ChessBoard *board, Move move, const U64 *key, const int color)
 {
-    // Handles pawn promotions
-    BitBoard promotion_mask = 0, en_passent_mask = 0;
-    if (piece == WHITE_PAWNS)
+    const int piece = moved_piece(board, MoveOrigin(move), color);
+    const int captured = move_captured_piece(board, move, color);
+
+    record_move(board, move, piece, captured);
+    move_piece(board, move, piece, captured, color);
+
+    // Invalid move if king is being attacked
+    if (square_attacked(board, bitboard_scan_forward(board->pieces[(color == WHITE) ? WHITE_KING : BLACK_KING]), color))
     {
-        promotion_mask = *move_mask & MASK_RANK[RANK_8];
-        *move_mask &= CLEAR_RANK[RANK_8];
+        undo_move(board, color);
+
+        StatsIncrement(illegal_moves);
+        return false;
+    }
+
+    finish_move(board, move, piece, captured, key, color);
+    return true;
+}
+
+/**
+ * Updates the chessboard's pieces after the given pseudo legal move is played. 
+ * Returns whether the move is legal. If the move is not legal the board is not
+ * updated. The null move is never legal.
+ **/
+bool chessboard_make_move(ChessBoard *board, Move move)
+{
+    // A failed move lookup must not move a piece from a1 to a1
+    if (IsNullMove(move))
+        return false;
+
+    StatsBegin(MAKE_MOVE);
 
-        en_passent_mask = *move_mask & board->en_passent;
-        *move_mask &= ~board->en_passent;
+    bool legal = (board->current_color == WHITE)
+        ? make_move(board, move, NULL, WHITE)
+        : make_move(board, move, NULL, BLACK);
+
+    StatsEnd(MAKE_MOVE);
+    return legal;
+}
+
+/**
+ * Same as chessboard_make_move, but takes the key the move leads to from the
+ * caller, who already computed it with chessboard_key_after.
+ **/
+bool chessboard_make_move_with_key(ChessBoard *board, Move move, U64 key)
+{
+    if (IsNullMove(move))
+        return false;
+
+    StatsBegin(MAKE_MOVE);
+
+    bool legal = (board->current_color == WHITE)
+        ? make_move(board, move, &key, WHITE)
+        : make_move(board, move, &key, BLACK);
+
+    StatsEnd(MAKE_MOVE);
+    return legal;
+}
+
+/**
+ * Fills the attacks on the given color, the side to move.
+ **/
+ColorSpecialized void attack_info(ChessBoard *board, AttackInfo *attacks, const int color)
+{
+    // Shift from white pieces to the opponent's pieces
+    const int opponent_shift = (color == WHITE) ? BLACK_PAWNS - WHITE_PAWNS : 0;
+
+    int king = bitboard_scan_forward(board->pieces[(color == WHITE) ? WHITE_KING : BLACK_KING]);
+    BitBoard occupied = board->occupied_squares;
+    BitBoard pawns = board->pieces[WHITE_PAWNS + opponent_shift];
+    BitBoard knights = board->pieces[WHITE_KNIGHTS + opponent_shift];
+    BitBoard diagonal = board->pieces[WHITE_BISHOPS + opponent_shift] | board->pieces[WHITE_QUEENS + opponent_shift];
+    BitBoard orthogonal = board->pieces[WHITE_ROOKS + opponent_shift] | board->pieces[WHITE_QUEENS + opponent_shift];
+
+    // Sliders see through the king so it can not step back along their ray
+    attacks->king_danger = attack_fill_side(board, color ^ 1, occupied ^ MASK_SQUARE[king]);
+
+    BitBoard bishop_rays = lookup_bishop_attacks(king, occupied);
+    BitBoard rook_rays = lookup_rook_attacks(king, occupied);
+    attacks->checkers = (MASK_PAWN_ATTACKS[color][king] & pawns)
+        | (MASK_KNIGHT_ATTACKS[king] & knights)
+        | (bishop_rays & diagonal)
+        | (rook_rays & orthogonal);
+
+    // The squares seen both from the king and from a slider on its ray are the ones between them
+    if (attacks->checkers == 0)
+    {
+        attacks->check_mask = ~(BitBoard) 0;
+    }
+    else if (attacks->checkers & (attacks->checkers - 1))
+    {
+        attacks->check_mask = 0;
     }
-    else if (piece == BLACK_PAWNS)
+    else
     {
-        promotion_mask = *move_mask & MASK_RANK[RANK_1];
-        *move_mask &= CLEAR_RANK[RANK_1];
+        int square = bitboard_scan_forward(attacks->checkers);
+        attacks->check_mask = attacks->checkers;
+        if (rook_rays & orthogonal & attacks->checkers)
+            attacks->check_mask |= rook_rays & lookup_rook_attacks(square, occupied);
+        else if (bishop_rays & diagonal & attacks->checkers)
+            attacks->check_mask |= bishop_rays & lookup_bishop_attacks(square, occupied);
+    }
+
+    // A piece is pinned if it is the only piece between the king and a slider on the same line
+    BitBoard own = board->pieces[color];
+    attacks->pinned = 0;
 
-        en_passent_mask = *move_mask & board->en_passent;
-        *move_mask &= ~board->en_passent;
+    BitBoard pieces;
+    for (pieces = orthogonal & lookup_rook_attacks(king, 0); pieces; pieces &= pieces - 1)
+        attacks->pinned |= rook_rays & lookup_rook_attacks(bitboard_scan_forward(pieces), occupied) & own;
+    for (pieces = diagonal & lookup_bishop_attacks(king, 0); pieces; pieces &= pieces - 1)
+        attacks->pinned |= bishop_rays & lookup_bishop_attacks(bitboard_scan_forward(pieces), occupied) & own;
+}
+
+/**
+ * Fills the attacks on the side to move: checkers, pinned pieces, the squares
+ * the king can not move to and the targets that resolve a check.
+ **/
+void chessboard_attack_info(ChessBoard *board, AttackInfo *attacks)
+{
+    if (board->current_color == WHITE)
+        attack_info(board, attacks, WHITE);
+    else
+        attack_info(board, attacks, BLACK);
+}
+
+/**
+ * Returns whether the pseudo legal move of the given color, the side to move,
+ * leaves its king safe.
+ **/
+ColorSpecialized bool is_legal(ChessBoard *board, AttackInfo *attacks, Move move, const int color)
+{
+    const int king = (color == WHITE) ? WHITE_KING : BLACK_KING;
+
+    // Castling is only generated when the king does not pass through an attacked square
+    if (board->pieces[king] & MASK_SQUARE[MoveOrigin(move)])
+    {
+        return MoveType(move) == KING_CASTLE || MoveType(move) == QUEEN_CASTLE
+            || !(attacks->king_danger & MASK_SQUARE[MoveTarget(move)]);
     }
 
-    int target;
-    while ((target = bitboard_pop(move_mask)) != -1)
+    // Pinned pieces and en passent, which removes two pieces from a line, are rare enough to play out
+    if (MoveType(move) == EN_PASSENT || (attacks->pinned & MASK_SQUARE[MoveOrigin(move)]))
     {
-        int captured_piece = chessboard_get_piece(board, MASK_SQUARE[target]);
+        const int piece = moved_piece(board, MoveOrigin(move), color);
+        const int captured = move_captured_piece(board, move, color);
 
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, NORMAL_MOVE
-        };
+        move_piece(board, move, piece, captured, color);
+        bool legal = !square_attacked(board, bitboard_scan_forward(board->pieces[king]), color);
+        move_piece(board, move, piece, captured, color);
+
+        return legal;
     }
-    while ((target = bitboard_pop(&en_passent_mask)) != -1)
-    {
-        int captured_piece = (piece == WHITE_PAWNS) ? BLACK_PAWNS : WHITE_PAWNS;
 
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, EN_PASSENT
-        };
+    return (attacks->check_mask & MASK_SQUARE[MoveTarget(move)]) != 0;
+}
+
+/**
+ * Returns whether the pseudo legal move leaves the king of the side to move
+ * safe, using the attacks of the position instead of playing the move.
+ **/
+bool chessboard_is_legal(ChessBoard *board, AttackInfo *attacks, Move move)
+{
+    bool legal = (board->current_color == WHITE)
+        ? is_legal(board, attacks, move, WHITE)
+        : is_legal(board, attacks, move, BLACK);
+
+    if (!legal)
+        StatsIncrement(illegal_moves);
+
+    return legal;
+}
+
+/**
+ * Returns whether the given color, the side to move, could generate the move
+ * in the current position.
+ **/
+ColorSpecialized bool is_pseudo_legal(ChessBoard *board, Move move, const int color)
+{
+    // Shift to change piece color from white to black
+    const int color_shift = (color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS);
+
+    const int origin = MoveOrigin(move), target = MoveTarget(move), type = MoveType(move);
+    const BitBoard target_mask = MASK_SQUARE[target];
+
+    // Moves are only ever packed into the lower 15 bits
+    if ((move >> 15) || !(board->pieces[color] & MASK_SQUARE[origin]) || (board->pieces[color] & target_mask))
+        return false;
+
+    const int piece = moved_piece(board, origin, color);
+
+    if (type == KING_CASTLE || type == QUEEN_CASTLE)
+    {
+        // Castling is generated with the squares offset to the back rank of the color
+        const int back_rank = (color == WHITE) ? 0 : A8 - A1;
+        bool king_side = type == KING_CASTLE;
+
+        if (piece != WHITE_KING + color_shift || origin != E1 + back_rank || target != (king_side ? G1 : C1) + back_rank)
+            return false;
+
+        int permission = (color == WHITE)
+            ? (king_side ? WHITE_KING_SIDE : WHITE_QUEEN_SIDE)
+            : (king_side ? BLACK_KING_SIDE : BLACK_QUEEN_SIDE);
+        BitBoard path = (color == WHITE)
+            ? (king_side ? MASK_F1_TO_G1 : MASK_B1_TO_D1)
+            : (king_side ? MASK_F8_TO_G8 : MASK_B8_TO_D8);
+        int passed_square = king_side ? F1 + back_rank : D1 + back_rank;
+
+        return (board->castle_permission & permission) && !(board->occupied_squares & path)
+            && !square_attacked(board, origin, color) && !square_attacked(board, passed_square, color)
+            && !square_attacked(board, target, color);
     }
-    while ((target = bitboard_pop(&promotion_mask)) != -1)
+
+    if (piece != WHITE_PAWNS + color_shift)
     {
-        int captured_piece = chessboard_get_piece(board, MASK_SQUARE[target]);
+        if (type != NORMAL_MOVE)
+            return false;
 
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, ROOK_PROMOTION
-        };
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, KNIGHT_PROMOTION
-        };
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, BISHOP_PROMOTION
-        };
-        list->moves[list->size++] = (Move) {
-            origin, target, piece, captured_piece, QUEEN_PROMOTION
-        };
+        switch (piece)
+        {
+            case WHITE_ROOKS: case BLACK_ROOKS:
+                return lookup_rook_attacks(origin, board->occupied_squares) & target_mask;
+            case WHITE_BISHOPS: case BLACK_BISHOPS:
+                return lookup_bishop_attacks(origin, board->occupied_squares) & target_mask;
+            case WHITE_QUEENS: case BLACK_QUEENS:
+                return lookup_queen_attacks(origin, board->occupied_squares) & target_mask;
+            case WHITE_KNIGHTS: case BLACK_KNIGHTS:
+                return MASK_KNIGHT_ATTACKS[origin] & target_mask;
+            default:
+                return MASK_KING_ATTACKS[origin] & target_mask;
+        }
     }
+
+    if (type == EN_PASSENT)
+        return (board->en_passent & target_mask) && (MASK_PAWN_ATTACKS[color][origin] & target_mask);
+
+    // Pawns promote exactly when they reach the last rank
+    bool last_rank = MASK_RANK[(color == WHITE) ? RANK_8 : RANK_1] & target_mask;
+    if (last_rank != (type >= ROOK_PROMOTION))
+        return false;
+
+    const int push = (color == WHITE) ? 8 : -8;
+
+    if (MASK_PAWN_ATTACKS[color][origin] & target_mask)
+        return board->pieces[color ^ 1] & target_mask;
+    if (target == origin + push)
+        return board->empty_squares & target_mask;
+    if (target == origin + 2 * push)
+    {
+        return (MASK_RANK[(color == WHITE) ? RANK_2 : RANK_7] & MASK_SQUARE[origin])
+            && (board->empty_squares & MASK_SQUARE[origin + push]) && (board->empty_squares & target_mask);
+    }
+
+    return false;
 }
 
 /**
- * Generates all possible pseudo legal moves in a given possition 
- * and adds them to the given MoveList.
+ * Returns whether the move could have been generated in the current position,
+ * so a move from the transposition table or a book can be played without
+ * generating every move.
  **/
-void chessboard_generate_moves(ChessBoard *board, MoveList *list)
+bool chessboard_is_pseudo_legal(ChessBoard *board, Move move)
 {
-    list->size = 0;
+    return (board->current_color == WHITE)
+        ? is_pseudo_legal(board, move, WHITE)
+        : is_pseudo_legal(board, move, BLACK);
+}
+
+/**
+ * Plays the legal move of the given color, the side to move, with the key it
+ * leads to if known.
+ **/
+ColorSpecialized void play_move(ChessBoard *board, Move move, const U64 *key, const int color)
+{
+    const int piece = moved_piece(board, MoveOrigin(move), color);
+    const int captured = move_captured_piece(board, move, color);
+
+    record_move(board, move, piece, captured);
+    move_piece(board, move, piece, captured, color);
+    finish_move(board, move, piece, captured, key, color);
+}
+
+/**
+ * Updates the chessboard's pieces after the given legal move is played,
+ * without testing whether it leaves the king in check.
+ **/
+void chessboard_play_move(ChessBoard *board, Move move)
+{
+    StatsBegin(MAKE_MOVE);
 
-    // Gets squares pawns can attack on including en passent
-    BitBoard available_pawn_attacks;
     if (board->current_color == WHITE)
-        available_pawn_attacks = board->pieces[BLACK] | board->en_passent;
+        play_move(board, move, NULL, WHITE);
     else
-        available_pawn_attacks = board->pieces[WHITE] | board->en_passent;
+        play_move(board, move, NULL, BLACK);
+
+    StatsEnd(MAKE_MOVE);
+}
 
-    int start = (board->current_color == WHITE) ? WHITE_PAWNS : BLACK_PAWNS;
-    for (int piece = start; piece < start + 6; piece++)
+/**
+ * Same as chessboard_play_move, but takes the key the move leads to from the
+ * caller, who already computed it with chessboard_key_after.
+ **/
+void chessboard_play_move_with_key(ChessBoard *board, Move move, U64 key)
+{
+    StatsBegin(MAKE_MOVE);
+
+    if (board->current_color == WHITE)
+        play_move(board, move, &key, WHITE);
+    else
+        play_move(board, move, &key, BLACK);
+
+    StatsEnd(MAKE_MOVE);
+}
+
+/**
+ * Updates the chessboard's pieces after undoing the last moved played.
+ **/
+void chessboard_undo_move(ChessBoard *board)
+{
+    StatsBegin(UNDO_MOVE);
+
+    if (PieceColor(board->move_history[board->num_moves - 1].piece) == WHITE)
+        undo_move(board, WHITE);
+    else
+        undo_move(board, BLACK);
+
+    StatsEnd(UNDO_MOVE);
+}
+
+/**
+ * Appends a move from the origin to each square in the move_mask.
+ **/
+static inline void append_moves(MoveList *list, BitBoard move_mask, int origin)
+{
+    int target;
+    while ((target = bitboard_pop(&move_mask)) != -1)
+        list->moves[list->size++] = CreateMove(origin, target, NORMAL_MOVE);
+}
+
+/**
+ * Appends a pawn move to each square in the move_mask, coming from the square
+ * offset squares behind it. Moves to the last rank are appended as promotions.
+ **/
+ColorSpecialized void append_pawn_moves(MoveList *list, BitBoard move_mask, const int offset, const int color)
+{
+    const BitBoard last_rank = MASK_RANK[(color == WHITE) ? RANK_8 : RANK_1];
+
+    BitBoard promotion_mask = move_mask & last_rank;
+    move_mask &= ~last_rank;
+
+    // Tests the masks before scanning them since most are empty
+    for (; move_mask; move_mask &= move_mask - 1)
+    {
+        int target = bitboard_scan_forward(move_mask);
+        list->moves[list->size++] = CreateMove(target - offset, target, NORMAL_MOVE);
+    }
+    for (; promotion_mask; promotion_mask &= promotion_mask - 1)
     {
-        BitBoard attack_mask, piece_mask = board->pieces[piece];
+        int target = bitboard_scan_forward(promotion_mask);
+
+        list->moves[list->size++] = CreateMove(target - offset, target, ROOK_PROMOTION);
+        list->moves[list->size++] = CreateMove(target - offset, target, KNIGHT_PROMOTION);
+        list->moves[list->size++] = CreateMove(target - offset, target, BISHOP_PROMOTION);
+        list->moves[list->size++] = CreateMove(target - offset, target, QUEEN_PROMOTION);
+    }
+}
+
+/**
+ * Generates the pawn moves of the given color by shifting all of its pawns at
+ * once, so every kind of move is found for all pawns with a few operations.
+ **/
+ColorSpecialized void generate_pawn_moves(ChessBoard *board, MoveList *list, const int color)
+{
+    // Offsets from origin to target of pushes and of captures towards the a and h files
+    const int push = (color == WHITE) ? 8 : -8;
+    const int west = (color == WHITE) ? 7 : -9;
+    const int east = (color == WHITE) ? 9 : -7;
+
+    const int pawn = (color == WHITE) ? WHITE_PAWNS : BLACK_PAWNS;
+
+    BitBoard pawns = board->pieces[pawn];
+    BitBoard west_pawns = pawns & CLEAR_FILE[FILE_A], east_pawns = pawns & CLEAR_FILE[FILE_H];
+
+    BitBoard single_pushes = ((color == WHITE) ? pawns << 8 : pawns >> 8) & board->empty_squares;
+    BitBoard double_pushes = ((color == WHITE) ? single_pushes << 8 & MASK_RANK[RANK_4] : single_pushes >> 8 & MASK_RANK[RANK_5])
+        & board->empty_squares;
+    BitBoard west_attacks = (color == WHITE) ? west_pawns << 7 : west_pawns >> 9;
+    BitBoard east_attacks = (color == WHITE) ? east_pawns << 9 : east_pawns >> 7;
+
+    append_pawn_moves(list, single_pushes, push, color);
+    append_pawn_moves(list, double_pushes, 2 * push, color);
+    append_pawn_moves(list, west_attacks & board->pieces[color ^ 1], west, color);
+    append_pawn_moves(list, east_attacks & board->pieces[color ^ 1], east, color);
 
-        int origin;
-        while((origin = bitboard_pop(&piece_mask)) != -1)
+    // The en passent square is always empty, so it is only reached by the attacks
+    if (west_attacks & board->en_passent)
+    {
+        int target = bitboard_scan_forward(board->en_passent);
+        list->moves[list->size++] = CreateMove(target - west, target, EN_PASSENT);
+    }
+    if (east_attacks & board->en_passent)
+    {
+        int target = bitboard_scan_forward(board->en_passent);
+        list->moves[list->size++] = CreateMove(target - east, target, EN_PASSENT);
+    }
+}
+
+/**
+ * Appends the moves of every piece of the given kind, other than pawns, to
+ * the squares not held by the given color.
+ **/
+ColorSpecialized void generate_piece_moves(ChessBoard *board, MoveList *list, const int piece, const int color)
+{
+    BitBoard piece_mask = board->pieces[piece];
+
+    int origin;
+    while ((origin = bitboard_pop(&piece_mask)) != -1)
+    {
+        BitBoard attack_mask;
+        switch (piece)
         {
-            switch (piece)
-            {
-                case WHITE_PAWNS:
-                    // White pawn single push
-                    attack_mask = MASK_SQUARE[origin] << 8 & board->empty_squares;
-                    // White pawn double push
-                    attack_mask |= attack_mask << 8 & MASK_RANK[RANK_4] & board->empty_squares;
-                    // White pawn attack 
-                    attack_mask |= MASK_PAWN_ATTACKS[WHITE][origin] & available_pawn_attacks;
-                    break;
-                case BLACK_PAWNS:
-                    // Black pawn single push
-                    attack_mask = MASK_SQUARE[origin] >> 8 & board->empty_squares;
-                    // Black pawn double push
-                    attack_mask |= attack_mask >> 8 & MASK_RANK[RANK_5] & board->empty_squares;
-                    // Black pawn attack
-                    attack_mask |= MASK_PAWN_ATTACKS[BLACK][origin] & available_pawn_attacks;
-                    break;
-                case WHITE_ROOKS: case BLACK_ROOKS:
-                    attack_mask = lookup_rook_attacks(origin, board->occupied_squares);
-                    break;
-                case WHITE_BISHOPS: case BLACK_BISHOPS:
-                    attack_mask = lookup_bishop_attacks(origin, board->occupied_squares);
-                    break;
-                case WHITE_QUEENS: case BLACK_QUEENS:
-                    attack_mask = lookup_queen_attacks(origin, board->occupied_squares);
-                    break;
-                case WHITE_KNIGHTS: case BLACK_KNIGHTS:
-                    attack_mask = MASK_KNIGHT_ATTACKS[origin];
-                    break;
-                case WHITE_KING: case BLACK_KING:
-                    attack_mask = MASK_KING_ATTACKS[origin];
-                    break;
-            }
-
-            attack_mask &= ~board->pieces[board->current_color];
-
-            append_moves(board, list, &attack_mask, origin, piece);
+            case WHITE_ROOKS: case BLACK_ROOKS:
+                attack_mask = lookup_rook_attacks(origin, board->occupied_squares);
+                break;
+            case WHITE_BISHOPS: case BLACK_BISHOPS:
+                attack_mask = lookup_bishop_attacks(origin, board->occupied_squares);
+                break;
+            case WHITE_QUEENS: case BLACK_QUEENS:
+                attack_mask = lookup_queen_attacks(origin, board->occupied_squares);
+                break;
+            case WHITE_KNIGHTS: case BLACK_KNIGHTS:
+                attack_mask = MASK_KNIGHT_ATTACKS[origin];
+                break;
+            default:
+                attack_mask = MASK_KING_ATTACKS[origin];
+                break;
         }
+
+        append_moves(list, attack_mask & ~board->pieces[color], origin);
     }
+}
 
-    // Generates castling moves
-    if (board->current_color == WHITE)
-    {   
-        // White castle king side
-        if (board->castle_permission & WHITE_KING_SIDE)
-        {	
-            bool passes_through_check = chessboard_squared_attacked(board, E1) 
-                || chessboard_squared_attacked(board, F1) 
-                || chessboard_squared_attacked(board, G1);
-            bool path_clear = !(board->occupied_squares & MASK_F1_TO_G1);
-
-            if (path_clear && !passes_through_check)
-                list->moves[list->size++] = (Move) {E1, G1, WHITE_KING, EMPTY, KING_CASTLE};
-        }
+/**
+ * Generates the pseudo legal moves of the given color, the side to move.
+ **/
+ColorSpecialized void generate_moves(ChessBoard *board, MoveList *list, const int color)
+{
+    // Shift to change piece color from white to black
+    const int color_shift = (color == WHITE) ? 0 : (BLACK_PAWNS - WHITE_PAWNS);
 
-        // White castle queen side
-        if (board->castle_permission & WHITE_QUEEN_SIDE)
-        {
-            bool passes_through_check = chessboard_squared_attacked(board, E1) 
-                || chessboard_squared_attacked(board, D1) 
-                || chessboard_squared_attacked(board, C1);
-            bool path_clear = !(board->occupied_squares & MASK_B1_TO_D1);
+    generate_pawn_moves(board, list, color);
+    generate_piece_moves(board, list, WHITE_ROOKS + color_shift, color);
+    generate_piece_moves(board, list, WHITE_KNIGHTS + color_shift, color);
+    generate_piece_moves(board, list, WHITE_BISHOPS + color_shift, color);
+    generate_piece_moves(board, list, WHITE_QUEENS + color_shift, color);
+    generate_piece_moves(board, list, WHITE_KING + color_shift, color);
 
-            if (path_clear && !passes_through_check)
-                list->moves[list->size++] = (Move) {E1, C1, WHITE_KING, EMPTY, QUEEN_CASTLE};
-        }
+    // Generates castling moves from the attacks found before, with the squares offset to the back rank of the color
+    const int back_rank = (color == WHITE) ? 0 : A8 - A1;
+
+    if (board->castle_permission & ((color == WHITE) ? WHITE_KING_SIDE : BLACK_KING_SIDE))
+    {
+        bool passes_through_check = list->attacks.king_danger & (MASK_SQUARE[E1 + back_rank] | MASK_SQUARE[F1 + back_rank] | MASK_SQUARE[G1 + back_rank]);
+        bool path_clear = !(board->occupied_squares & ((color == WHITE) ? MASK_F1_TO_G1 : MASK_F8_TO_G8));
+
+        if (path_clear && !passes_through_check)
+            list->moves[list->size++] = CreateMove(E1 + back_rank, G1 + back_rank, KING_CASTLE);
+    }
+
+    if (board->castle_permission & ((color == WHITE) ? WHITE_QUEEN_SIDE : BLACK_QUEEN_SIDE))
+    {
+        bool passes_through_check = list->attacks.king_danger & (MASK_SQUARE[E1 + back_rank] | MASK_SQUARE[D1 + back_rank] | MASK_SQUARE[C1 + back_rank]);
+        bool path_clear = !(board->occupied_squares & ((color == WHITE) ? MASK_B1_TO_D1 : MASK_B8_TO_D8));
+
+        if (path_clear && !passes_through_check)
+            list->moves[list->size++] = CreateMove(E1 + back_rank, C1 + back_rank, QUEEN_CASTLE);
+    }
+}
+
+/**
+ * Generates all possible pseudo legal moves in a given possition 
+ * and adds them to the given MoveList, along with the attacks on the
+ * side to move.
+ **/
+void chessboard_generate_moves(ChessBoard *board, MoveList *list)
+{
+    StatsBegin(GENERATE_MOVES);
+
+    list->size = 0;
+
+    if (board->current_color == WHITE)
+    {
+        attack_info(board, &list->attacks, WHITE);
+        generate_moves(board, list, WHITE);
     }
     else
     {
-        // Black castle king side
-        if (board->castle_permission & BLACK_KING_SIDE)
-        {
-            bool passes_through_check = chessboard_squared_attacked(board, E8) 
-                || chessboard_squared_attacked(board, F8) 
-                || chessboard_squared_attacked(board, G8); 
-            bool path_clear = !(board->occupied_squares & MASK_F8_TO_G8);
+        attack_info(board, &list->attacks, BLACK);
+        generate_moves(board, list, BLACK);
+    }
 
-            if (path_clear && !passes_through_check)
-                list->moves[list->size++] = (Move) {E8, G8, BLACK_KING, EMPTY, KING_CASTLE};
-        }
+    StatsEnd(GENERATE_MOVES);
+}
 
-        // Black castle queen side
-        if (board->castle_permission & BLACK_QUEEN_SIDE)
+/**
+ * Returns the number of leaf nodes of the legal move tree of the given depth.
+ **/
+U64 chessboard_perft(ChessBoard *board, int depth)
+{
+    if (depth == 0)
+        return 1;
+
+    U64 num_nodes = 0;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+    for (int i = 0; i < list.size; i++)
+    {
+        if (chessboard_is_legal(board, &list.attacks, list.moves[i]))
         {
-            bool passes_through_check = chessboard_squared_attacked(board, E8) 
-                || chessboard_squared_attacked(board, D8) 
-                || chessboard_squared_attacked(board, C8);
-            bool path_clear = !(board->occupied_squares & MASK_B8_TO_D8); 
+            chessboard_play_move(board, list.moves[i]);
+            num_nodes += chessboard_perft(board, depth - 1);
 
-            if (path_clear && !passes_through_check)
-                list->moves[list->size++] = (Move) {E8, C8, BLACK_KING, EMPTY, QUEEN_CASTLE};
+            chessboard_undo_move(board);
         }
     }
+
+    return num_nodes;
 }
 
 /**
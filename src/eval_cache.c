@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "eval_cache.h"
+#include "huge_pages.h"
+#include "stats.h"
+
+#define EntryKey(key) ((key) & 0xffffffff00000000)
+
+/**
+ * Returns an evaluation cache with room for the given number of entries (rounded
+ * down to a power of two) whose entries are allocated on huge pages. Null will
+ * be returned if the cache was not able to be allocated.
+ **/
+EvalCache* eval_cache_init(int size)
+{
+    if (size < 1)
+        return NULL;
+
+    EvalCache *cache = malloc(sizeof(EvalCache));
+
+    if (cache == NULL)
+        return NULL;
+
+    // Rounds the size down to a power of two so slots can be selected with a mask
+    U64 num_entries = 1;
+    while (num_entries * 2 <= (U64) size)
+        num_entries *= 2;
+
+    cache->entries = huge_pages_alloc(num_entries * sizeof(U64));
+    cache->mask = num_entries - 1;
+
+    if (cache->entries == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+/**
+ * Frees the memory the evaluation cache was taking up.
+ **/
+void eval_cache_free(EvalCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    huge_pages_free(cache->entries, (cache->mask + 1) * sizeof(U64));
+    free(cache);
+}
+
+/**
+ * Removes every entry from the evaluation cache.
+ **/
+void eval_cache_clear(EvalCache *cache)
+{
+    memset(cache->entries, 0, (cache->mask + 1) * sizeof(U64));
+}
+
+/**
+ * Starts loading the slot of the given key into the cache, so a probe issued
+ * shortly after does not wait on memory.
+ **/
+void eval_cache_prefetch(EvalCache *cache, U64 key)
+{
+    __builtin_prefetch(&cache->entries[key & cache->mask]);
+}
+
+/**
+ * Looks up the static evaluation stored for the given position key. Returns
+ * whether the key was found, in which case score is filled with the evaluation.
+ **/
+bool eval_cache_probe(EvalCache *cache, U64 key, int *score)
+{
+    // Copies the entry once so the key check and score come from the same read
+    U64 entry = cache->entries[key & cache->mask];
+
+    if (EntryKey(entry) != EntryKey(key))
+    {
+        StatsIncrement(eval_cache_misses);
+        return false;
+    }
+
+    *score = (int) (U32) entry;
+    StatsIncrement(eval_cache_hits);
+    return true;
+}
+
+/**
+ * Stores the static evaluation of the position with the given key, replacing
+ * whatever entry previously occupied its slot.
+ **/
+void eval_cache_store(EvalCache *cache, U64 key, int score)
+{
+    cache->entries[key & cache->mask] = EntryKey(key) | (U32) score;
+}
+
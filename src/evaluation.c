@@ -0,0 +1,46 @@
+#include "evaluation.h"
+
+int EVAL_WEIGHTS[NUM_EVAL_TERMS] = {
+    10, // TERM_PAWN
+    50, // TERM_ROOK
+    30, // TERM_KNIGHT
+    30, // TERM_BISHOP
+    90, // TERM_QUEEN
+};
+
+char *EVAL_TERM_NAMES[NUM_EVAL_TERMS] = {
+    "pawn",
+    "rook",
+    "knight",
+    "bishop",
+    "queen",
+};
+
+/**
+ * Fills the coefficients of every term for the board from white's point of
+ * view, such that the evaluation is the sum of coefficient times weight.
+ **/
+void evaluation_terms(ChessBoard *board, int coefficients[NUM_EVAL_TERMS])
+{
+    // Material terms follow the order of the pieces
+    for (int term = TERM_PAWN; term <= TERM_QUEEN; term++)
+    {
+        coefficients[term] = bitboard_count(board->pieces[WHITE_PAWNS + term])
+            - bitboard_count(board->pieces[BLACK_PAWNS + term]);
+    }
+}
+
+/**
+ * Returns the evaluation of the board from white's point of view.
+ **/
+int evaluation_evaluate(ChessBoard *board)
+{
+    int coefficients[NUM_EVAL_TERMS];
+    evaluation_terms(board, coefficients);
+
+    int score = 0;
+    for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        score += coefficients[term] * EVAL_WEIGHTS[term];
+
+    return score;
+}
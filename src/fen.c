@@ -0,0 +1,578 @@
+#include <string.h>
+#include "fen.h"
+#include "lookup_tables.h"
+
+#define IsSpace(c) ((c) == ' ' || (c) == '\t')
+#define IsDigit(c) ('0' <= (c) && (c) <= '9')
+
+static char *ERROR_STRINGS[] = {
+    "ok",
+    "invalid piece placement",
+    "each side needs exactly one king",
+    "invalid side to move",
+    "invalid castling rights",
+    "invalid en passent square",
+    "invalid move clocks",
+    "invalid epd operation",
+    "illegal or ambiguous move",
+};
+
+static char PIECE_CHARACTERS[] = "  PRNBQKprnbqk";
+
+/**
+ * Returns a pointer to the first character after any spaces or tabs.
+ **/
+static char* skip_spaces(char *str)
+{
+    while (IsSpace(*str))
+        str++;
+
+    return str;
+}
+
+/**
+ * Parses an unsigned decimal number into value. Returns a pointer to the first
+ * character after the number, or NULL if there is no number.
+ **/
+static char* parse_number(char *str, U64 *value)
+{
+    if (!IsDigit(*str))
+        return NULL;
+
+    *value = 0;
+    for (; IsDigit(*str); str++)
+        *value = *value * 10 + (*str - '0');
+
+    return str;
+}
+
+/**
+ * Writes the unsigned decimal number into the buffer and returns its length.
+ **/
+static int write_number(char *buffer, unsigned value)
+{
+    char digits[10];
+    int length = 0;
+
+    do
+    {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    for (int i = 0; i < length; i++)
+        buffer[i] = digits[length - 1 - i];
+
+    return length;
+}
+
+/**
+ * Parses the FEN string into the position fields of the board: the pieces,
+ * side to move, castling, en passent square, clocks and key. The move history
+ * is left alone. Returns FEN_OK or the first field that is malformed.
+ **/
+static FenError parse_position(ChessBoard *board, char *fen, char **end)
+{
+    memset(board->pieces, 0, sizeof(board->pieces));
+    board->en_passent = 0;
+    board->castle_permission = 0;
+    board->num_half_moves = 0;
+    board->num_full_moves = 1;
+
+    char *str = skip_spaces(fen);
+
+    // Parses the piece placement from rank 8 down to rank 1
+    for (int rank = RANK_8, file = FILE_A;; str++)
+    {
+        char c = *str;
+
+        if ('1' <= c && c <= '8')
+        {
+            file += c - '0';
+        }
+        else if (c == '/')
+        {
+            if (file != 8 || rank == RANK_1)
+                return FEN_INVALID_PIECES;
+
+            rank--;
+            file = FILE_A;
+            continue;
+        }
+        else if (IsSpace(c))
+        {
+            if (file != 8 || rank != RANK_1)
+                return FEN_INVALID_PIECES;
+
+            break;
+        }
+        else
+        {
+            Piece piece = fen_to_piece(c);
+            if (piece == EMPTY || file > FILE_H)
+                return FEN_INVALID_PIECES;
+
+            BitBoard square = FileRankToSquare(file, rank);
+            board->pieces[piece] |= square;
+            board->pieces[PieceColor(piece)] |= square;
+            file++;
+        }
+
+        if (file > 8)
+            return FEN_INVALID_PIECES;
+    }
+
+    if (bitboard_count(board->pieces[WHITE_KING]) != 1 || bitboard_count(board->pieces[BLACK_KING]) != 1)
+        return FEN_INVALID_KINGS;
+
+    // Pawns can never stand on the first or last rank
+    if ((board->pieces[WHITE_PAWNS] | board->pieces[BLACK_PAWNS]) & 0xff000000000000ff)
+        return FEN_INVALID_PIECES;
+
+    // Parses the side to move
+    str = skip_spaces(str);
+    if (*str == 'w')
+        board->current_color = WHITE;
+    else if (*str == 'b')
+        board->current_color = BLACK;
+    else
+        return FEN_INVALID_COLOR;
+
+    if (!IsSpace(str[1]))
+        return FEN_INVALID_COLOR;
+
+    // Parses the castling permissions
+    str = skip_spaces(str + 1);
+    if (*str == '-')
+    {
+        str++;
+    }
+    else
+    {
+        for (; !IsSpace(*str); str++)
+        {
+            int permission;
+            switch (*str)
+            {
+                case 'K':
+                    permission = WHITE_KING_SIDE;
+                    break;
+                case 'Q':
+                    permission = WHITE_QUEEN_SIDE;
+                    break;
+                case 'k':
+                    permission = BLACK_KING_SIDE;
+                    break;
+                case 'q':
+                    permission = BLACK_QUEEN_SIDE;
+                    break;
+                default:
+                    return FEN_INVALID_CASTLING;
+            }
+
+            if (board->castle_permission & permission)
+                return FEN_INVALID_CASTLING;
+
+            board->castle_permission |= permission;
+        }
+    }
+
+    if (!IsSpace(*str))
+        return FEN_INVALID_CASTLING;
+
+    // Parses the en passent square, which must be on the rank a pawn of the other side skips with a double step
+    str = skip_spaces(str);
+    if (*str == '-')
+    {
+        str++;
+    }
+    else
+    {
+        int rank = (board->current_color == WHITE) ? RANK_6 : RANK_3;
+        if (str[0] < 'a' || str[0] > 'h' || str[1] != '1' + rank)
+            return FEN_INVALID_EN_PASSENT;
+
+        board->en_passent = FileRankToSquare(str[0] - 'a', rank);
+        str += 2;
+    }
+
+    if (*str != '\0' && !IsSpace(*str) && *str != ';' && *str != '\n' && *str != '\r')
+        return FEN_INVALID_EN_PASSENT;
+
+    // Parses the optional half and full move clocks
+    char *clocks = skip_spaces(str);
+    if (IsDigit(*clocks))
+    {
+        U64 half_moves, full_moves;
+
+        clocks = parse_number(clocks, &half_moves);
+        clocks = skip_spaces(clocks);
+        clocks = parse_number(clocks, &full_moves);
+        if (clocks == NULL || half_moves > 0xffff || full_moves > 0xffff)
+            return FEN_INVALID_CLOCKS;
+
+        board->num_half_moves = half_moves;
+        board->num_full_moves = full_moves;
+        str = clocks;
+    }
+
+    board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
+    board->empty_squares = ~board->occupied_squares;
+    board->position_key = chessboard_hash(board);
+
+    if (end != NULL)
+        *end = str;
+
+    return FEN_OK;
+}
+
+/**
+ * Initializes the board with the given FEN string. The clocks are optional and
+ * default to 0 and 1. If end is not NULL it is set to the first character after
+ * the parsed fields. Returns FEN_OK or the first field that is malformed, in
+ * which case the board is left untouched.
+ **/
+FenError fen_parse(ChessBoard *board, char *fen, char **end)
+{
+    // Parses into a separate board so a malformed field can not leave this one half written
+    ChessBoard parsed;
+    FenError error = parse_position(&parsed, fen, end);
+    if (error != FEN_OK)
+        return error;
+
+    memcpy(board->pieces, parsed.pieces, sizeof(board->pieces));
+    board->occupied_squares = parsed.occupied_squares;
+    board->empty_squares = parsed.empty_squares;
+    board->en_passent = parsed.en_passent;
+    board->castle_permission = parsed.castle_permission;
+    board->num_half_moves = parsed.num_half_moves;
+    board->num_full_moves = parsed.num_full_moves;
+    board->current_color = parsed.current_color;
+    board->position_key = parsed.position_key;
+
+    // Clears the history of the previous position, which num_moves invalidates
+    board->num_moves = 0;
+    memset(board->repetition_filter, 0, sizeof(board->repetition_filter));
+
+    return FEN_OK;
+}
+
+/**
+ * Writes the four position fields shared by FEN and EPD: the piece placement,
+ * side to move, castling permissions and en passent square. Returns the end of
+ * the written fields, which are not terminated.
+ **/
+static char* write_position(ChessBoard *board, char *str)
+{
+    char squares[64];
+    memset(squares, 0, sizeof(squares));
+
+    for (Piece piece = WHITE_PAWNS; piece <= BLACK_KING; piece++)
+    {
+        BitBoard pieces = board->pieces[piece];
+        while (pieces)
+            squares[bitboard_pop(&pieces)] = PIECE_CHARACTERS[piece];
+    }
+
+    for (int rank = RANK_8; rank >= RANK_1; rank--)
+    {
+        int num_empty = 0;
+        for (int file = FILE_A; file <= FILE_H; file++)
+        {
+            char c = squares[rank * 8 + file];
+            if (c == 0)
+            {
+                num_empty++;
+                continue;
+            }
+
+            if (num_empty > 0)
+                *str++ = '0' + num_empty;
+            *str++ = c;
+            num_empty = 0;
+        }
+
+        if (num_empty > 0)
+            *str++ = '0' + num_empty;
+        if (rank != RANK_1)
+            *str++ = '/';
+    }
+
+    *str++ = ' ';
+    *str++ = (board->current_color == WHITE) ? 'w' : 'b';
+    *str++ = ' ';
+
+    if (board->castle_permission == 0)
+        *str++ = '-';
+    if (board->castle_permission & WHITE_KING_SIDE)
+        *str++ = 'K';
+    if (board->castle_permission & WHITE_QUEEN_SIDE)
+        *str++ = 'Q';
+    if (board->castle_permission & BLACK_KING_SIDE)
+        *str++ = 'k';
+    if (board->castle_permission & BLACK_QUEEN_SIDE)
+        *str++ = 'q';
+    *str++ = ' ';
+
+    if (board->en_passent)
+    {
+        int square = bitboard_scan_forward(board->en_passent);
+        *str++ = 'a' + square % 8;
+        *str++ = '1' + square / 8;
+    }
+    else
+    {
+        *str++ = '-';
+    }
+
+    return str;
+}
+
+/**
+ * Writes the board's FEN string into the given buffer, which must hold at
+ * least FEN_MAX_LENGTH characters. Returns the length of the string.
+ **/
+int fen_write(ChessBoard *board, char *fen)
+{
+    char *str = write_position(board, fen);
+
+    *str++ = ' ';
+    str += write_number(str, board->num_half_moves);
+    *str++ = ' ';
+    str += write_number(str, board->num_full_moves);
+    *str = '\0';
+
+    return str - fen;
+}
+
+/**
+ * Writes the four position fields of the board's EPD string, without the move
+ * clocks, into the given buffer, which must hold at least FEN_MAX_LENGTH
+ * characters. Returns the length of the string.
+ **/
+int epd_write(ChessBoard *board, char *epd)
+{
+    char *str = write_position(board, epd);
+    *str = '\0';
+
+    return str - epd;
+}
+
+/**
+ * Returns the move type of the promotion piece written in SAN, or NORMAL_MOVE
+ * if the character is not a promotion piece.
+ **/
+static MoveType san_promotion(char c)
+{
+    switch (c)
+    {
+        case 'Q':
+            return QUEEN_PROMOTION;
+        case 'R':
+            return ROOK_PROMOTION;
+        case 'B':
+            return BISHOP_PROMOTION;
+        case 'N':
+            return KNIGHT_PROMOTION;
+        default:
+            return NORMAL_MOVE;
+    }
+}
+
+/**
+ * Returns the legal move written in standard algebraic notation, or NULL_MOVE
+ * if the move is illegal or ambiguous. Only the first length characters of
+ * san are read.
+ **/
+Move fen_parse_san(ChessBoard *board, char *san, int length)
+{
+    // Strips check, mate and annotation symbols
+    while (length > 0 && strchr("+#!?", san[length - 1]) != NULL)
+        length--;
+
+    Piece piece = WHITE_PAWNS;
+    MoveType move_type = NORMAL_MOVE;
+    int target = -1, origin_file = -1, origin_rank = -1;
+
+    if ((length == 3 && (strncmp(san, "O-O", 3) == 0 || strncmp(san, "0-0", 3) == 0)))
+    {
+        move_type = KING_CASTLE;
+    }
+    else if ((length == 5 && (strncmp(san, "O-O-O", 5) == 0 || strncmp(san, "0-0-0", 5) == 0)))
+    {
+        move_type = QUEEN_CASTLE;
+    }
+    else
+    {
+        int start = 0;
+        if (length > 0 && strchr("RNBQK", san[0]) != NULL)
+            piece = fen_to_piece(san[start++]);
+
+        // Promotions are written as e8=Q or e8Q
+        if (length > 0 && piece == WHITE_PAWNS && san_promotion(san[length - 1]) != NORMAL_MOVE)
+        {
+            move_type = san_promotion(san[length - 1]);
+            length -= (length > 1 && san[length - 2] == '=') ? 2 : 1;
+        }
+
+        if (length - start < 2)
+            return NULL_MOVE;
+
+        char file = san[length - 2], rank = san[length - 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+            return NULL_MOVE;
+        target = (rank - '1') * 8 + (file - 'a');
+
+        // Whatever lies between the piece and the target disambiguates the origin
+        for (int i = start; i < length - 2; i++)
+        {
+            if ('a' <= san[i] && san[i] <= 'h')
+                origin_file = san[i] - 'a';
+            else if ('1' <= san[i] && san[i] <= '8')
+                origin_rank = san[i] - '1';
+            else if (san[i] != 'x' && san[i] != ':' && san[i] != '-')
+                return NULL_MOVE;
+        }
+    }
+
+    if (board->current_color == BLACK)
+        piece += BLACK_PAWNS - WHITE_PAWNS;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    Move found = NULL_MOVE;
+    int num_found = 0;
+    for (int i = 0; i < list.size; i++)
+    {
+        Move move = list.moves[i];
+
+        if (move_type == KING_CASTLE || move_type == QUEEN_CASTLE)
+        {
+            if (MoveType(move) != move_type)
+                continue;
+        }
+        else
+        {
+            MoveType type = (MoveType(move) == EN_PASSENT) ? NORMAL_MOVE : MoveType(move);
+            if (chessboard_moved_piece(board, move) != piece || MoveTarget(move) != target || type != move_type
+                || (origin_file >= 0 && MoveOrigin(move) % 8 != origin_file)
+                || (origin_rank >= 0 && MoveOrigin(move) / 8 != origin_rank))
+                continue;
+        }
+
+        if (!chessboard_make_move(board, move))
+            continue;
+        chessboard_undo_move(board);
+
+        found = move;
+        num_found++;
+    }
+
+    return (num_found == 1) ? found : NULL_MOVE;
+}
+
+/**
+ * Copies the operand of an id operation into the record, removing the quotes.
+ **/
+static void parse_id(EpdRecord *record, char *operand, int length)
+{
+    if (length >= 2 && operand[0] == '"' && operand[length - 1] == '"')
+    {
+        operand++;
+        length -= 2;
+    }
+
+    if (length >= EPD_MAX_ID_LENGTH)
+        length = EPD_MAX_ID_LENGTH - 1;
+
+    memcpy(record->id, operand, length);
+    record->id[length] = '\0';
+}
+
+/**
+ * Initializes the board and the record with the given EPD line. Returns FEN_OK
+ * or the first field or operation that is malformed.
+ **/
+FenError epd_parse(ChessBoard *board, EpdRecord *record, char *line)
+{
+    record->id[0] = '\0';
+    record->num_best_moves = 0;
+    memset(record->perft, 0, sizeof(record->perft));
+
+    char *str;
+    FenError error = fen_parse(board, line, &str);
+    if (error != FEN_OK)
+        return error;
+
+    while (true)
+    {
+        while (IsSpace(*str) || *str == ';')
+            str++;
+        if (*str == '\0' || *str == '\n' || *str == '\r')
+            return FEN_OK;
+
+        // Splits the operation into its opcode and operands, which may contain quoted ';'
+        char *opcode = str;
+        while (*str != '\0' && !IsSpace(*str) && *str != ';' && *str != '\n' && *str != '\r')
+            str++;
+        int opcode_length = str - opcode;
+
+        char *operand = str = skip_spaces(str);
+        for (bool quoted = false; *str != '\0' && *str != '\n' && *str != '\r' && (quoted || *str != ';'); str++)
+        {
+            if (*str == '"')
+                quoted = !quoted;
+        }
+
+        int operand_length = str - operand;
+        while (operand_length > 0 && IsSpace(operand[operand_length - 1]))
+            operand_length--;
+
+        if (opcode_length == 2 && opcode[0] == 'D' && '1' <= opcode[1] && opcode[1] <= '0' + EPD_MAX_PERFT_DEPTH)
+        {
+            if (parse_number(operand, &record->perft[opcode[1] - '0']) == NULL)
+                return EPD_INVALID_OPERATION;
+        }
+        else if (opcode_length == 2 && strncmp(opcode, "bm", 2) == 0)
+        {
+            for (int i = 0; i < operand_length;)
+            {
+                int move_length = 0;
+                while (i + move_length < operand_length && !IsSpace(operand[i + move_length]))
+                    move_length++;
+
+                Move move = fen_parse_san(board, operand + i, move_length);
+                if (IsNullMove(move))
+                    return EPD_INVALID_MOVE;
+                if (record->num_best_moves < EPD_MAX_BEST_MOVES)
+                    record->best_moves[record->num_best_moves++] = move;
+
+                for (i += move_length; i < operand_length && IsSpace(operand[i]); i++);
+            }
+        }
+        else if (opcode_length == 2 && strncmp(opcode, "id", 2) == 0)
+        {
+            parse_id(record, operand, operand_length);
+        }
+        else if (opcode_length == 4 && (strncmp(opcode, "hmvc", 4) == 0 || strncmp(opcode, "fmvn", 4) == 0))
+        {
+            U64 value;
+            if (parse_number(operand, &value) == NULL || value > 0xffff)
+                return EPD_INVALID_OPERATION;
+
+            if (opcode[0] == 'h')
+                board->num_half_moves = value;
+            else
+                board->num_full_moves = value;
+        }
+    }
+}
+
+/**
+ * Returns a description of the given error.
+ **/
+char* fen_error_string(FenError error)
+{
+    return ERROR_STRINGS[error];
+}
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "huge_pages.h"
+
+#define RoundUp(size) (((size) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE)
+
+typedef struct
+{
+    U8 *start;
+    U64 size;
+} ClearSlice;
+
+/**
+ * Zeroes the slice given as the argument.
+ **/
+static void* clear_slice(void *arg)
+{
+    ClearSlice *slice = arg;
+    memset(slice->start, 0, slice->size);
+
+    return NULL;
+}
+
+/**
+ * Returns zeroed memory of at least the given size aligned to a huge page.
+ * Null will be returned if the memory could not be mapped.
+ **/
+void* huge_pages_alloc(U64 size)
+{
+    if (size == 0)
+        return NULL;
+
+    size = RoundUp(size);
+
+#ifdef MAP_HUGETLB
+    // Reserved huge pages are always aligned, but most systems do not reserve any
+    U8 *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED)
+        return memory;
+#endif
+
+    // Maps an extra huge page to align the start, then unmaps what is left over
+    U8 *mapping = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    U8 *aligned = (U8*) RoundUp((U64) mapping);
+    if (aligned > mapping)
+        munmap(mapping, aligned - mapping);
+    munmap(aligned + size, mapping + HUGE_PAGE_SIZE - aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+    return aligned;
+}
+
+/**
+ * Unmaps memory returned by huge_pages_alloc for the given size.
+ **/
+void huge_pages_free(void *memory, U64 size)
+{
+    if (memory != NULL)
+        munmap(memory, RoundUp(size));
+}
+
+/**
+ * Zeroes the memory on num_threads threads, each clearing its own slice.
+ **/
+void huge_pages_clear(void *memory, U64 size, int num_threads)
+{
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > MAX_CLEAR_THREADS)
+        num_threads = MAX_CLEAR_THREADS;
+
+    // Slices are whole huge pages so no page is shared by two threads
+    U64 slice_size = RoundUp((size + num_threads - 1) / num_threads);
+    if (slice_size >= size)
+    {
+        memset(memory, 0, size);
+        return;
+    }
+
+    ClearSlice slices[MAX_CLEAR_THREADS];
+    pthread_t handles[MAX_CLEAR_THREADS];
+    bool started[MAX_CLEAR_THREADS];
+    int num_slices = 0;
+
+    for (U64 offset = 0; offset < size; offset += slice_size)
+    {
+        slices[num_slices].start = (U8*) memory + offset;
+        slices[num_slices].size = (size - offset < slice_size) ? size - offset : slice_size;
+        num_slices++;
+    }
+
+    // Clears the first slice on the calling thread and any slice whose thread did not start
+    for (int i = 1; i < num_slices; i++)
+        started[i] = pthread_create(&handles[i], NULL, clear_slice, &slices[i]) == 0;
+
+    clear_slice(&slices[0]);
+
+    for (int i = 1; i < num_slices; i++)
+    {
+        if (started[i])
+            pthread_join(handles[i], NULL);
+        else
+            clear_slice(&slices[i]);
+    }
+}
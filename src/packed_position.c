@@ -0,0 +1,420 @@
+#include <stdlib.h>
+#include <string.h>
+#include "packed_position.h"
+#include "lookup_tables.h"
+
+#define PACKED_MAGIC "CEPACK01"
+#define PACKED_INDEX_MAGIC "CEPACKIX"
+
+// A mask of the changed bytes precedes every compressed record
+#define MaskSize(record_size) (((record_size) + 7) / 8)
+
+/**
+ * Packs the board's position into 32 bytes. Returns false if the board has
+ * more than 32 pieces, which do not fit.
+ **/
+bool packed_encode(ChessBoard *board, PackedPosition *packed)
+{
+    if (bitboard_count(board->pieces[WHITE] | board->pieces[BLACK]) > 32)
+        return false;
+
+    U8 squares[64];
+    for (Piece piece = WHITE_PAWNS; piece <= BLACK_KING; piece++)
+    {
+        BitBoard pieces = board->pieces[piece];
+        while (pieces)
+            squares[bitboard_pop(&pieces)] = piece;
+    }
+
+    memset(packed, 0, sizeof(PackedPosition));
+    packed->occupancy = board->pieces[WHITE] | board->pieces[BLACK];
+
+    BitBoard occupancy = packed->occupancy;
+    for (int i = 0; occupancy && i < 32; i++)
+    {
+        int square = bitboard_pop(&occupancy);
+        packed->pieces[i / 2] |= squares[square] << (4 * (i % 2));
+    }
+
+    packed->color_castling = board->current_color | board->castle_permission << 1;
+    packed->en_passent = board->en_passent ? bitboard_scan_forward(board->en_passent) : 0;
+    packed->num_half_moves = board->num_half_moves;
+    packed->num_full_moves = board->num_full_moves;
+
+    return true;
+}
+
+/**
+ * Initializes the board with the packed position.
+ **/
+void packed_decode(PackedPosition *packed, ChessBoard *board)
+{
+    memset(board->pieces, 0, sizeof(board->pieces));
+
+    // Hashes the pieces while placing them, which saves a second pass in chessboard_hash
+    U64 key = 0;
+    BitBoard occupancy = packed->occupancy;
+    for (int i = 0; occupancy && i < 32; i++)
+    {
+        int square = bitboard_pop(&occupancy);
+        Piece piece = (packed->pieces[i / 2] >> (4 * (i % 2))) & 0xf;
+
+        // Skips corrupt codes rather than writing past the piece bitboards
+        if (piece < WHITE_PAWNS || piece > BLACK_KING)
+            continue;
+
+        board->pieces[piece] |= MASK_SQUARE[square];
+        board->pieces[PieceColor(piece)] |= MASK_SQUARE[square];
+        key ^= PIECE_KEYS[piece - WHITE_PAWNS][square];
+    }
+
+    board->current_color = packed->color_castling & 1;
+    board->castle_permission = (packed->color_castling >> 1) & 0xf;
+    board->en_passent = packed->en_passent ? MASK_SQUARE[packed->en_passent & 63] : 0;
+    board->num_half_moves = packed->num_half_moves;
+    board->num_full_moves = packed->num_full_moves;
+    board->num_moves = 0;
+    memset(board->repetition_filter, 0, sizeof(board->repetition_filter));
+
+    board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
+    board->empty_squares = ~board->occupied_squares;
+    board->position_key = key ^ CASTLE_KEYS[board->castle_permission] ^ SIDE_KEY[board->current_color];
+}
+
+/**
+ * Stores the records of a chunk as the XOR with the previous record, keeping
+ * only the bytes that changed. Returns the stored size.
+ **/
+static U32 compress_chunk(U8 *chunk, U32 num_records, U32 record_size, U8 *buffer)
+{
+    U8 *previous = NULL, *out = buffer;
+
+    for (U32 i = 0; i < num_records; i++)
+    {
+        U8 *record = chunk + i * record_size;
+        U8 *mask = out;
+
+        memset(mask, 0, MaskSize(record_size));
+        out += MaskSize(record_size);
+
+        for (U32 j = 0; j < record_size; j++)
+        {
+            U8 diff = record[j] ^ (previous ? previous[j] : 0);
+            if (diff)
+            {
+                mask[j / 8] |= 1 << (j % 8);
+                *out++ = diff;
+            }
+        }
+
+        previous = record;
+    }
+
+    return out - buffer;
+}
+
+/**
+ * Restores the records stored by compress_chunk. Returns false if the stored
+ * bytes are corrupt.
+ **/
+static bool decompress_chunk(U8 *buffer, U32 size, U32 num_records, U32 record_size, U8 *chunk)
+{
+    U8 *in = buffer, *end = buffer + size, *previous = NULL;
+
+    for (U32 i = 0; i < num_records; i++)
+    {
+        U8 *record = chunk + i * record_size;
+        U8 *mask = in;
+
+        in += MaskSize(record_size);
+        if (in > end)
+            return false;
+
+        for (U32 j = 0; j < record_size; j++)
+        {
+            U8 diff = 0;
+            if (mask[j / 8] & (1 << (j % 8)))
+            {
+                if (in == end)
+                    return false;
+                diff = *in++;
+            }
+
+            record[j] = diff ^ (previous ? previous[j] : 0);
+        }
+
+        previous = record;
+    }
+
+    return in == end;
+}
+
+/**
+ * Writes the buffered records as a chunk and records its offset in the index.
+ **/
+static bool write_chunk(PackedWriter *writer)
+{
+    if (writer->chunk_length == 0)
+        return true;
+
+    if (writer->num_chunks == writer->max_chunks)
+    {
+        U64 max_chunks = (writer->max_chunks > 0) ? writer->max_chunks * 2 : 64;
+        U64 *offsets = realloc(writer->offsets, max_chunks * sizeof(U64));
+        if (offsets == NULL)
+            return false;
+
+        writer->offsets = offsets;
+        writer->max_chunks = max_chunks;
+    }
+    writer->offsets[writer->num_chunks++] = ftell(writer->file);
+
+    U8 *data = writer->chunk;
+    U32 size = writer->chunk_length * writer->record_size;
+    if (writer->flags & PACKED_COMPRESSED)
+    {
+        size = compress_chunk(writer->chunk, writer->chunk_length, writer->record_size, writer->buffer);
+        data = writer->buffer;
+    }
+
+    bool success = fwrite(&writer->chunk_length, sizeof(U32), 1, writer->file) == 1
+        && fwrite(&size, sizeof(U32), 1, writer->file) == 1
+        && fwrite(data, 1, size, writer->file) == size;
+
+    writer->chunk_length = 0;
+
+    return success;
+}
+
+/**
+ * Creates a container file for records of record_size bytes. Returns NULL if
+ * the file could not be created.
+ **/
+PackedWriter* packed_writer_open(char *filename, U32 record_size, U32 flags)
+{
+    if (record_size == 0 || record_size > PACKED_MAX_RECORD_SIZE)
+        return NULL;
+
+    PackedWriter *writer = calloc(1, sizeof(PackedWriter));
+    if (writer == NULL)
+        return NULL;
+
+    writer->record_size = record_size;
+    writer->chunk_size = PACKED_CHUNK_SIZE;
+    writer->flags = flags;
+    writer->chunk = malloc(PACKED_CHUNK_SIZE * record_size);
+    writer->buffer = malloc(PACKED_CHUNK_SIZE * (record_size + MaskSize(record_size)));
+    writer->file = fopen(filename, "wb");
+
+    if (writer->chunk == NULL || writer->buffer == NULL || writer->file == NULL)
+    {
+        if (writer->file != NULL)
+            fclose(writer->file);
+        free(writer->chunk);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+
+    fwrite(PACKED_MAGIC, 1, 8, writer->file);
+    fwrite(&writer->record_size, sizeof(U32), 1, writer->file);
+    fwrite(&writer->chunk_size, sizeof(U32), 1, writer->file);
+    fwrite(&writer->flags, sizeof(U32), 1, writer->file);
+
+    return writer;
+}
+
+/**
+ * Appends a record to the container. Returns false on write errors.
+ **/
+bool packed_writer_add(PackedWriter *writer, void *record)
+{
+    memcpy(writer->chunk + writer->chunk_length * writer->record_size, record, writer->record_size);
+    writer->chunk_length++;
+    writer->num_records++;
+
+    if (writer->chunk_length == writer->chunk_size)
+        return write_chunk(writer);
+
+    return true;
+}
+
+/**
+ * Writes the last chunk and the index and closes the container. Returns false
+ * on write errors.
+ **/
+bool packed_writer_close(PackedWriter *writer)
+{
+    bool success = write_chunk(writer);
+
+    U64 index_offset = ftell(writer->file);
+    success = success
+        && fwrite(writer->offsets, sizeof(U64), writer->num_chunks, writer->file) == writer->num_chunks
+        && fwrite(&index_offset, sizeof(U64), 1, writer->file) == 1
+        && fwrite(&writer->num_records, sizeof(U64), 1, writer->file) == 1
+        && fwrite(PACKED_INDEX_MAGIC, 1, 8, writer->file) == 8;
+
+    success = (fclose(writer->file) == 0) && success;
+
+    free(writer->offsets);
+    free(writer->chunk);
+    free(writer->buffer);
+    free(writer);
+
+    return success;
+}
+
+/**
+ * Opens a container file written by a PackedWriter. Returns NULL if the file
+ * could not be read or is not a container, including files whose chunks hold
+ * more than PACKED_MAX_CHUNK_SIZE records or whose index does not match the
+ * number of records.
+ **/
+PackedReader* packed_reader_open(char *filename)
+{
+    PackedReader *reader = calloc(1, sizeof(PackedReader));
+    if (reader == NULL)
+        return NULL;
+
+    reader->file = fopen(filename, "rb");
+    if (reader->file == NULL)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    char magic[8], index_magic[8];
+    U64 index_offset;
+    long trailer_offset;
+
+    bool valid = fread(magic, 1, 8, reader->file) == 8
+        && memcmp(magic, PACKED_MAGIC, 8) == 0
+        && fread(&reader->record_size, sizeof(U32), 1, reader->file) == 1
+        && fread(&reader->chunk_size, sizeof(U32), 1, reader->file) == 1
+        && fread(&reader->flags, sizeof(U32), 1, reader->file) == 1
+        && reader->record_size > 0 && reader->record_size <= PACKED_MAX_RECORD_SIZE
+        && reader->chunk_size > 0 && reader->chunk_size <= PACKED_MAX_CHUNK_SIZE
+        && fseek(reader->file, -24, SEEK_END) == 0
+        && (trailer_offset = ftell(reader->file)) >= 0
+        && fread(&index_offset, sizeof(U64), 1, reader->file) == 1
+        && fread(&reader->num_records, sizeof(U64), 1, reader->file) == 1
+        && fread(index_magic, 1, 8, reader->file) == 8
+        && memcmp(index_magic, PACKED_INDEX_MAGIC, 8) == 0;
+
+    // The index must fill the space between its offset and the trailer, one offset per chunk
+    if (valid)
+    {
+        reader->num_chunks = (reader->num_records + reader->chunk_size - 1) / reader->chunk_size;
+        valid = index_offset <= (U64) trailer_offset
+            && (U64) trailer_offset - index_offset == reader->num_chunks * sizeof(U64);
+    }
+
+    if (valid)
+    {
+        reader->offsets = (reader->num_chunks > 0) ? malloc(reader->num_chunks * sizeof(U64)) : NULL;
+        reader->chunk = malloc(reader->chunk_size * reader->record_size);
+        reader->buffer = malloc(reader->chunk_size * (reader->record_size + MaskSize(reader->record_size)));
+
+        valid = (reader->offsets != NULL || reader->num_chunks == 0) && reader->chunk != NULL && reader->buffer != NULL
+            && fseek(reader->file, index_offset, SEEK_SET) == 0
+            && fread(reader->offsets, sizeof(U64), reader->num_chunks, reader->file) == reader->num_chunks;
+    }
+
+    if (!valid)
+    {
+        packed_reader_close(reader);
+        return NULL;
+    }
+
+    reader->current_chunk = (U64) -1;
+
+    return reader;
+}
+
+/**
+ * Reads and decodes the chunk with the given index. Returns false if the chunk
+ * could not be read or is corrupt.
+ **/
+static bool read_chunk(PackedReader *reader, U64 index)
+{
+    U32 num_records, size;
+
+    reader->current_chunk = index;
+    reader->chunk_length = 0;
+    reader->chunk_position = 0;
+
+    if (fseek(reader->file, reader->offsets[index], SEEK_SET) != 0
+        || fread(&num_records, sizeof(U32), 1, reader->file) != 1
+        || fread(&size, sizeof(U32), 1, reader->file) != 1
+        || num_records > reader->chunk_size
+        || size > reader->chunk_size * (reader->record_size + MaskSize(reader->record_size)))
+        return false;
+
+    if (reader->flags & PACKED_COMPRESSED)
+    {
+        if (fread(reader->buffer, 1, size, reader->file) != size
+            || !decompress_chunk(reader->buffer, size, num_records, reader->record_size, reader->chunk))
+            return false;
+    }
+    else if (size != num_records * reader->record_size
+        || fread(reader->chunk, 1, size, reader->file) != size)
+    {
+        return false;
+    }
+
+    reader->chunk_length = num_records;
+
+    return true;
+}
+
+/**
+ * Reads the next record into the given buffer. Returns false once every record
+ * has been read.
+ **/
+bool packed_reader_next(PackedReader *reader, void *record)
+{
+    if (reader->chunk_position == reader->chunk_length)
+    {
+        if (reader->current_chunk + 1 >= reader->num_chunks || !read_chunk(reader, reader->current_chunk + 1))
+            return false;
+    }
+
+    memcpy(record, reader->chunk + reader->chunk_position * reader->record_size, reader->record_size);
+    reader->chunk_position++;
+
+    return true;
+}
+
+/**
+ * Reads the record with the given index into the given buffer and continues
+ * sequential reading after it. Returns false if the index is out of range.
+ **/
+bool packed_reader_get(PackedReader *reader, U64 index, void *record)
+{
+    if (index >= reader->num_records)
+        return false;
+
+    U64 chunk = index / reader->chunk_size;
+    if (chunk != reader->current_chunk && !read_chunk(reader, chunk))
+        return false;
+
+    reader->chunk_position = index % reader->chunk_size;
+    if (reader->chunk_position >= reader->chunk_length)
+        return false;
+
+    return packed_reader_next(reader, record);
+}
+
+/**
+ * Closes the container file.
+ **/
+void packed_reader_close(PackedReader *reader)
+{
+    if (reader->file != NULL)
+        fclose(reader->file);
+
+    free(reader->offsets);
+    free(reader->chunk);
+    free(reader->buffer);
+    free(reader);
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static char *COUNTER_NAMES[NUM_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "L1D misses",
+    "LLC misses",
+    "branch misses",
+};
+
+#ifdef __linux__
+
+/**
+ * Sets the perf_event_open type and config of the given counter.
+ **/
+static void counter_config(CounterType counter, struct perf_event_attr *attr)
+{
+    switch (counter)
+    {
+        case COUNTER_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case COUNTER_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case COUNTER_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D
+                | PERF_COUNT_HW_CACHE_OP_READ << 8
+                | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+            break;
+        case COUNTER_LLC_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+/**
+ * Opens the hardware performance counters of the calling thread with Linux's
+ * perf_event_open. Counters the kernel or hardware does not support are left
+ * closed. Returns whether at least one counter could be opened.
+ **/
+bool perf_counters_open(PerfCounters *counters)
+{
+    bool opened = false;
+
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counter_config(counter, &attr);
+
+        counters->fds[counter] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        counters->values[counter] = 0;
+
+        if (counters->fds[counter] != -1)
+            opened = true;
+    }
+
+    return opened;
+}
+
+/**
+ * Starts counting events for a measured region.
+ **/
+void perf_counters_start(PerfCounters *counters)
+{
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        if (counters->fds[counter] == -1)
+            continue;
+
+        ioctl(counters->fds[counter], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[counter], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/**
+ * Stops counting events and adds the events of the measured region to the
+ * accumulated counter values.
+ **/
+void perf_counters_stop(PerfCounters *counters)
+{
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        if (counters->fds[counter] == -1)
+            continue;
+
+        ioctl(counters->fds[counter], PERF_EVENT_IOC_DISABLE, 0);
+
+        // Scales the count up if the kernel multiplexed the counter with others
+        U64 result[3];
+        if (read(counters->fds[counter], result, sizeof(result)) != sizeof(result))
+            continue;
+
+        U64 value = result[0];
+        if (result[2] != 0 && result[2] < result[1])
+            value = (U64) ((double) value * result[1] / result[2]);
+
+        counters->values[counter] += value;
+    }
+}
+
+#else
+
+bool perf_counters_open(PerfCounters *counters)
+{
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        counters->fds[counter] = -1;
+        counters->values[counter] = 0;
+    }
+
+    return false;
+}
+
+void perf_counters_start(PerfCounters *counters)
+{
+}
+
+void perf_counters_stop(PerfCounters *counters)
+{
+}
+
+#endif
+
+/**
+ * Closes every open performance counter.
+ **/
+void perf_counters_close(PerfCounters *counters)
+{
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        if (counters->fds[counter] != -1)
+            close(counters->fds[counter]);
+
+        counters->fds[counter] = -1;
+    }
+}
+
+/**
+ * Clears the accumulated counter values.
+ **/
+void perf_counters_reset(PerfCounters *counters)
+{
+    memset(counters->values, 0, sizeof(counters->values));
+}
+
+/**
+ * Prints the accumulated counter values of the named region, both in total and
+ * divided by the number of nodes visited in it.
+ **/
+void perf_counters_print(PerfCounters *counters, char *region, U64 nodes)
+{
+    printf("%-16s %18s %12s\n", region, "total", "per node");
+
+    for (int counter = 0; counter < NUM_COUNTERS; counter++)
+    {
+        if (counters->fds[counter] == -1)
+        {
+            printf("  %-14s %18s %12s\n", COUNTER_NAMES[counter], "not supported", "-");
+            continue;
+        }
+
+        printf("  %-14s %18llu %12.3f\n",
+            COUNTER_NAMES[counter],
+            (unsigned long long) counters->values[counter],
+            (nodes > 0) ? (double) counters->values[counter] / nodes : 0.0);
+    }
+}
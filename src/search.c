@@ -1,98 +1,694 @@
-#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
-#include <math.h>
+#include <time.h>
+#include <pthread.h>
 #include "search.h"
+#include "evaluation.h"
+#include "tablebase.h"
+#include "stats.h"
+#include "trace.h"
+
+#define ASPIRATION_WINDOW 25
+
+// Score and principal variation of one of the lines searched at the root
+typedef struct
+{
+    int score;
+    PrincipalVariation pv;
+} RootLine;
+
+/**
+ * Returns the time in milliseconds from an arbitrary fixed point.
+ **/
+long search_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Switches a search started while pondering to a normal search that respects
+ * its time limits, measured from now.
+ **/
+void search_ponderhit(SearchInfo *info)
+{
+    atomic_store(&info->start_time, search_time());
+    atomic_store(&info->pondering, false);
+}
 
 int search_evaluation(ChessBoard *board)
 {
-    static const int PIECE_VALUE[] = {0, 0, 10, 50, 30, 30, 90, 0, 10, 50, 30, 30, 90, 0};
+    StatsBegin(EVALUATION);
+
+    int score = evaluation_evaluate(board);
+    if (board->current_color == BLACK)
+        score = -score;
+
+    StatsEnd(EVALUATION);
+    return score;
+}
+
+/**
+ * Returns the number of moves to the mate of the given mate score, negative if
+ * the side to move is mated.
+ **/
+int search_mate_moves(int score)
+{
+    return (score > 0) ? (MATE_SCORE - score + 1) / 2 : -(MATE_SCORE + score) / 2;
+}
 
-    // Loops through the white colors
-    int white_score = 0;
-    for (Piece piece = WHITE_PAWNS; piece <= WHITE_KING; piece++)
+/**
+ * Returns the given score, which is not a mate score, in centipawns. Wins and
+ * losses of the endgame tables are reported as TABLEBASE_WIN_CP less the ply
+ * they are reached at rather than scaled like evaluations.
+ **/
+int search_centipawns(int score)
+{
+    if (IsTablebaseScore(score))
     {
-        white_score += bitboard_count(board->pieces[piece]) * PIECE_VALUE[piece];
+        return (score > 0) ? TABLEBASE_WIN_CP - (TABLEBASE_WIN_SCORE - score)
+            : -TABLEBASE_WIN_CP + (TABLEBASE_WIN_SCORE + score);
     }
 
-    // Loops through the black colors
-    int black_score = 0;
-    for (int piece = BLACK_PAWNS; piece <= BLACK_KING; piece++)
+    return score * 10;
+}
+
+/**
+ * Returns the static evaluation of the board, reusing the score stored in the
+ * evaluation cache when the position has already been evaluated.
+ **/
+static int cached_evaluation(EvalCache *eval_cache, ChessBoard *board)
+{
+    if (eval_cache == NULL)
+        return search_evaluation(board);
+
+    int score;
+    if (eval_cache_probe(eval_cache, board->position_key, &score))
+        return score;
+
+    score = search_evaluation(board);
+    eval_cache_store(eval_cache, board->position_key, score);
+
+    return score;
+}
+
+/**
+ * Adds the nodes the thread searched since the last flush to the shared count.
+ **/
+static void flush_nodes(SearchThread *thread)
+{
+    atomic_fetch_add(&thread->info->nodes, thread->nodes - thread->flushed_nodes);
+    thread->flushed_nodes = thread->nodes;
+}
+
+/**
+ * Sets the stop flag once the search has used up its time or node budget.
+ **/
+static void check_limits(SearchThread *thread)
+{
+    SearchInfo *info = thread->info;
+
+    flush_nodes(thread);
+
+    if (atomic_load(&info->stop))
+        return;
+
+    if (info->limits.nodes && atomic_load(&info->nodes) >= info->limits.nodes)
+    {
+        TraceEvent(TRACE_STOP, STOP_NODES);
+        atomic_store(&info->stop, true);
+    }
+    else if (info->time_budget && !atomic_load(&info->pondering)
+        && search_time() - atomic_load(&info->start_time) >= info->time_budget)
     {
-        black_score += bitboard_count(board->pieces[piece]) * PIECE_VALUE[piece];
+        TraceEvent(TRACE_STOP, STOP_TIME);
+        atomic_store(&info->stop, true);
     }
+}
+
+/**
+ * Converts a mate or tablebase score relative to the root into one relative to
+ * the current node so it can be stored in the transposition table.
+ **/
+static int score_to_table(int score, int ply)
+{
+    if (score >= TABLEBASE_WIN_SCORE - MAX_PLY)
+        return score + ply;
+    if (score <= -TABLEBASE_WIN_SCORE + MAX_PLY)
+        return score - ply;
 
-    return board->current_color == WHITE 
-        ? white_score - black_score 
-        : black_score - white_score;
+    return score;
 }
 
-int search_negamax(ChessBoard *board, int depth, int alpha, int beta)
+/**
+ * Converts a mate or tablebase score loaded from the transposition table back
+ * into one relative to the root.
+ **/
+static int score_from_table(int score, int ply)
 {
-    if (depth == 0)
-        return search_evaluation(board);
-    
+    if (score >= TABLEBASE_WIN_SCORE - MAX_PLY)
+        return score - ply;
+    if (score <= -TABLEBASE_WIN_SCORE + MAX_PLY)
+        return score + ply;
+
+    return score;
+}
+
+/**
+ * Assigns every move an ordering score. The transposition table move is tried
+ * first, followed by captures ordered by most valuable victim and least
+ * valuable attacker.
+ **/
+static void score_moves(ChessBoard *board, MoveList *list, Move table_move)
+{
+    static const int ORDER_VALUE[] = {0, 0, 1, 5, 3, 3, 9, 10, 1, 5, 3, 3, 9, 10, 0};
+
+    for (int i = 0; i < list->size; i++)
+    {
+        Move move = list->moves[i];
+        Piece captured = chessboard_captured_piece(board, move);
+
+        if (SameMove(move, table_move))
+            list->scores[i] = 10000;
+        else if (captured != EMPTY)
+            list->scores[i] = 1000 + 10 * ORDER_VALUE[captured] - ORDER_VALUE[chessboard_moved_piece(board, move)];
+        else if (MoveType(move) >= ROOK_PROMOTION)
+            list->scores[i] = 500 + MoveType(move);
+        else
+            list->scores[i] = 0;
+    }
+}
+
+/**
+ * Swaps the highest scoring move at or after index into index.
+ **/
+static void pick_move(MoveList *list, int index)
+{
+    int best = index;
+    for (int i = index + 1; i < list->size; i++)
+    {
+        if (list->scores[i] > list->scores[best])
+            best = i;
+    }
+
+    Move move = list->moves[index];
+    list->moves[index] = list->moves[best];
+    list->moves[best] = move;
+
+    int16_t score = list->scores[index];
+    list->scores[index] = list->scores[best];
+    list->scores[best] = score;
+}
+
+/**
+ * Starts loading the slot the child reached by the move will probe, so it
+ * arrives while the move is tested for legality and made. Returns the child's
+ * key so making the move does not compute it again.
+ **/
+static U64 prefetch_child(SearchInfo *info, ChessBoard *board, Move move, int depth)
+{
+    U64 child_key = chessboard_key_after(board, move);
+    if (depth > 1)
+        table_prefetch(info->table, child_key);
+    else if (info->eval_cache != NULL)
+        eval_cache_prefetch(info->eval_cache, child_key);
+
+    return child_key;
+}
+
+/**
+ * Searches the child reached by the move, which has just been played, and
+ * undoes it. The best score and move, alpha and the principal variation are
+ * updated with the child's score. Returns whether no other move should be
+ * searched, after a cutoff or when the search is stopped.
+ **/
+static bool search_move(SearchThread *thread, Move move, int depth, int *alpha, int beta, int *best_score, Move *best_move)
+{
+    int ply = thread->ply;
+
+    thread->ply++;
+    int score = -search_negamax(thread, depth - 1, -beta, -*alpha);
+    thread->ply--;
+
+    chessboard_undo_move(&thread->board);
+
+    // The score of a stopped search is not used
+    if (atomic_load_explicit(&thread->info->stop, memory_order_relaxed))
+        return true;
+
+    if (score > *best_score)
+    {
+        *best_score = score;
+
+        if (score > *alpha)
+        {
+            *alpha = score;
+            *best_move = move;
+
+            // Extends the principal variation with the child's
+            PrincipalVariation *pv = &thread->pv[ply], *child_pv = &thread->pv[ply + 1];
+            pv->moves[0] = move;
+            memcpy(&pv->moves[1], child_pv->moves, child_pv->size * sizeof(Move));
+            pv->size = child_pv->size + 1;
+        }
+    }
+
+    return *alpha >= beta;
+}
+
+/**
+ * Returns whether the move is skipped at the root because a better line of
+ * this iteration already starts with it.
+ **/
+static bool is_excluded(SearchThread *thread, Move move)
+{
+    for (int i = 0; i < thread->num_excluded; i++)
+    {
+        if (SameMove(thread->excluded[i], move))
+            return true;
+    }
+
+    return false;
+}
+
+int search_negamax(SearchThread *thread, int depth, int alpha, int beta)
+{
+    SearchInfo *info = thread->info;
+    ChessBoard *board = &thread->board;
+    int ply = thread->ply;
+
+    thread->pv[ply].size = 0;
+
+    if ((++thread->nodes & 1023) == 0)
+        check_limits(thread);
+    if (atomic_load_explicit(&info->stop, memory_order_relaxed))
+        return 0;
+
+    // Ends lines that repeat a position or reach the fifty move rule, but still finds a move at the root
+    if (ply > 0 && chessboard_is_draw(board))
+        return 0;
+
+    // Scores positions of the endgame tables without searching them
+    TablebaseWdl wdl;
+    if (ply > 0 && tablebase_probe_wdl(board, &wdl))
+    {
+        return (wdl == TABLEBASE_WIN) ? TABLEBASE_WIN_SCORE - ply
+            : (wdl == TABLEBASE_LOSS) ? -TABLEBASE_WIN_SCORE + ply
+            : 0;
+    }
+
+    if (depth == 0 || ply >= MAX_PLY - 1)
+        return cached_evaluation(info->eval_cache, board);
+
+    // Cuts off with the stored score if the position was already searched deep enough
+    Move table_move = NULL_MOVE;
+    EntryData entry;
+    if (table_probe(info->table, board->position_key, &entry))
+    {
+        table_move = entry.move;
+
+        int score = score_from_table(entry.score, ply);
+        if (ply > 0 && entry.depth >= depth && (entry.bound == BOUND_EXACT
+            || (entry.bound == BOUND_LOWER && score >= beta)
+            || (entry.bound == BOUND_UPPER && score <= alpha)))
+            return score;
+    }
+
+    int original_alpha = alpha;
+    int best_score = -INFINITE_SCORE;
+    Move best_move = NULL_MOVE;
     int num_played_moves = 0;
+    bool cutoff = false;
 
-    int score = INT_MIN;
+    // Tries the table move before generating the other moves, since it is often enough for a cutoff
+    bool table_move_played = false;
+    if (!IsNullMove(table_move) && chessboard_is_pseudo_legal(board, table_move)
+        && !(ply == 0 && is_excluded(thread, table_move)))
+    {
+        U64 child_key = prefetch_child(info, board, table_move, depth);
 
-    MoveList list;
-    chessboard_generate_moves(board, &list);
-    for (int i = 0; i < list.size; i++)
+        if (chessboard_make_move_with_key(board, table_move, child_key))
+        {
+            table_move_played = true;
+            num_played_moves++;
+
+            cutoff = search_move(thread, table_move, depth, &alpha, beta, &best_score, &best_move);
+            if (atomic_load_explicit(&info->stop, memory_order_relaxed))
+                return 0;
+            if (cutoff)
+                StatsIncrement(table_move_cutoffs);
+        }
+    }
+
+    if (!cutoff)
     {
-        if (chessboard_make_move(board, list.moves[i]))
+        MoveList list;
+        chessboard_generate_moves(board, &list);
+        score_moves(board, &list, table_move);
+
+        for (int i = 0; i < list.size; i++)
         {
-            score = fmax(score, -search_negamax(board, depth - 1, -beta, -alpha));
-            alpha = fmax(score, alpha);
+            pick_move(&list, i);
 
-            chessboard_undo_move(board);
+            Move move = list.moves[i];
+            if (table_move_played && SameMove(move, table_move))
+                continue;
+            if (ply == 0 && is_excluded(thread, move))
+                continue;
 
-            if(alpha >= beta)
-                break;
+            U64 child_key = prefetch_child(info, board, move, depth);
+
+            if (!chessboard_is_legal(board, &list.attacks, move))
+                continue;
 
+            chessboard_play_move_with_key(board, move, child_key);
             num_played_moves++;
+
+            cutoff = search_move(thread, move, depth, &alpha, beta, &best_score, &best_move);
+            if (atomic_load_explicit(&info->stop, memory_order_relaxed))
+                return 0;
+            if (cutoff)
+            {
+                StatsCutoff(i);
+                break;
+            }
         }
+
+        // The current player is in check or stale mate
+        if (num_played_moves == 0)
+            return list.attacks.checkers ? -MATE_SCORE + ply : 0;
     }
 
-    // The current player is in check or stale mate
-    if (num_played_moves == 0)
+    // The root without its excluded moves is not the position the table entry stands for
+    if (ply == 0 && thread->num_excluded > 0)
+        return best_score;
+
+    Bound bound = (best_score >= beta) ? BOUND_LOWER
+        : (best_score > original_alpha) ? BOUND_EXACT
+        : BOUND_UPPER;
+    table_store(info->table, board->position_key, best_move, score_to_table(best_score, ply), depth, bound);
+
+    return best_score;
+}
+
+/**
+ * Searches the root with a narrow window around the previous iteration's score,
+ * widening the window whenever the score falls outside of it.
+ **/
+static int aspiration_search(SearchThread *thread, int depth, int previous_score)
+{
+    if (depth <= 4 || IsMateScore(previous_score))
+        return search_negamax(thread, depth, -INFINITE_SCORE, INFINITE_SCORE);
+
+    int delta = ASPIRATION_WINDOW;
+    int alpha = previous_score - delta, beta = previous_score + delta;
+    while (true)
     {
-        int king_square = bitboard_scan_forward(board->current_color == WHITE ? WHITE_KING : BLACK_KING);
+        int score = search_negamax(thread, depth, alpha, beta);
+
+        if (atomic_load(&thread->info->stop))
+            return score;
 
-        // Checkmate
-        if (chessboard_squared_attacked(board, bitboard_scan_forward(king_square)))
-            return INT_MIN;
-        // Stalemate
+        if (score <= alpha)
+            alpha = (alpha - delta < -INFINITE_SCORE) ? -INFINITE_SCORE : alpha - delta;
+        else if (score >= beta)
+            beta = (beta + delta > INFINITE_SCORE) ? INFINITE_SCORE : beta + delta;
         else
-            return 0;
-    }
+            return score;
 
-    return score;
+        TraceEvent(TRACE_ASPIRATION_RESEARCH, depth);
+        delta *= 2;
+    }
 }
 
-Move search_position(ChessBoard *board)
+/**
+ * Returns the number of lines the thread searches at the root: the lines asked
+ * for on the main thread, as long as there are legal moves to start them.
+ **/
+static int count_lines(SearchThread *thread)
 {
-    Move best_move;
-    int best_score = INT_MIN;
+    int multi_pv = thread->info->multi_pv;
+    if (thread->id != 0 || multi_pv <= 1)
+        return 1;
 
     MoveList list;
-    chessboard_generate_moves(board, &list);
+    int num_legal_moves = 0;
+    chessboard_generate_moves(&thread->board, &list);
     for (int i = 0; i < list.size; i++)
     {
-        if (chessboard_make_move(board, list.moves[i]))
+        if (chessboard_is_legal(&thread->board, &list.attacks, list.moves[i]))
+            num_legal_moves++;
+    }
+
+    int num_lines = (multi_pv < MAX_MULTI_PV) ? multi_pv : MAX_MULTI_PV;
+    if (num_lines > num_legal_moves)
+        num_lines = (num_legal_moves > 0) ? num_legal_moves : 1;
+
+    return num_lines;
+}
+
+/**
+ * Sorts the lines from the highest score to the lowest, keeping lines with the
+ * same score in the order they were searched.
+ **/
+static void sort_lines(RootLine *lines, int num_lines)
+{
+    for (int i = 1; i < num_lines; i++)
+    {
+        RootLine line = lines[i];
+
+        int j = i;
+        for (; j > 0 && lines[j - 1].score < line.score; j--)
+            lines[j] = lines[j - 1];
+        lines[j] = line;
+    }
+}
+
+/**
+ * Runs iterative deepening on the thread's board and returns the best move of
+ * the deepest completed iteration. Every iteration searches each line with the
+ * first moves of the lines before it excluded, so the lines share the
+ * iterations and the table instead of being separate searches. The lines are
+ * then sorted by score, since a later line can beat an earlier one inside its
+ * window, and the best move is taken from the best of them.
+ **/
+static Move iterative_deepening(SearchThread *thread)
+{
+    SearchInfo *info = thread->info;
+    int max_depth = (info->limits.depth > 0 && info->limits.depth < MAX_PLY)
+        ? info->limits.depth
+        : MAX_PLY - 1;
+
+    Move best_move = NULL_MOVE;
+    int num_lines = count_lines(thread);
+
+    // Lines of the last iteration by score, whose scores center the windows of the next one
+    RootLine lines[MAX_MULTI_PV];
+    for (int line = 0; line < num_lines; line++)
+        lines[line].score = 0;
+
+    // Helper threads start on alternating depths to spread out over the tree
+    for (int depth = 1 + thread->id % 2; depth <= max_depth; depth++)
+    {
+        TraceEvent(TRACE_ITERATION_START, depth);
+
+        int num_searched = 0;
+        for (int line = 0; line < num_lines; line++)
         {
-            int new_score = -search_negamax(board, 4, INT_MIN, INT_MAX);
+            thread->num_excluded = line;
+            int score = aspiration_search(thread, depth, lines[line].score);
+
+            if (atomic_load(&info->stop) && !IsNullMove(best_move))
+                break;
+
+            lines[line].score = score;
+            lines[line].pv = thread->pv[0];
+            if (thread->pv[0].size > 0)
+                thread->excluded[line] = thread->pv[0].moves[0];
+            num_searched++;
+
+            if (atomic_load(&info->stop))
+                break;
+        }
+        TraceEvent(TRACE_ITERATION_END, depth);
 
-            if (best_score < new_score)
+        if (num_searched == 0)
+            break;
+
+        // Only the lines of a stopped iteration that were searched are ranked and reported
+        sort_lines(lines, num_searched);
+        if (lines[0].pv.size > 0)
+            best_move = lines[0].pv.moves[0];
+
+        if (thread->id == 0)
+        {
+            flush_nodes(thread);
+
+            for (int line = 0; line < num_searched && info->report != NULL; line++)
+                info->report(info, depth, line, lines[line].score, &lines[line].pv);
+
+            // Avoids starting an iteration that is unlikely to finish in time
+            if (info->time_budget && !atomic_load(&info->pondering)
+                && search_time() - atomic_load(&info->start_time) >= info->time_budget / 2)
+                break;
+        }
+
+        if (atomic_load(&info->stop))
+            break;
+    }
+
+    thread->num_excluded = 0;
+
+    return best_move;
+}
+
+/**
+ * Entry point of the helper threads.
+ **/
+static void* helper_thread_main(void *arg)
+{
+    iterative_deepening((SearchThread *) arg);
+    StatsMerge();
+
+    return NULL;
+}
+
+/**
+ * Returns the time in milliseconds the side to move may spend on this search.
+ * Zero is returned if the search is not limited by time.
+ **/
+static long allocate_time(SearchLimits *limits, int color)
+{
+    if (limits->move_time)
+        return limits->move_time;
+    if (limits->infinite || limits->time[color] == 0)
+        return 0;
+
+    int moves_to_go = (limits->moves_to_go > 0) ? limits->moves_to_go : 30;
+    long budget = limits->time[color] / moves_to_go + limits->increment[color] * 3 / 4;
+
+    // Keeps a safety margin for communication overhead
+    long max_budget = limits->time[color] - 50;
+    if (budget > max_budget)
+        budget = (max_budget > 1) ? max_budget : 1;
+
+    return budget;
+}
+
+/**
+ * Reports the move chosen by the endgame tables as a completed iteration with
+ * the table's mate score and returns it.
+ **/
+static Move report_table_move(SearchInfo *info, Move move, TablebaseWdl wdl, int plies)
+{
+    PrincipalVariation pv = {.moves = {move}, .size = 1};
+    int score = (wdl == TABLEBASE_WIN) ? MATE_SCORE - plies
+        : (wdl == TABLEBASE_LOSS) ? -MATE_SCORE + plies
+        : 0;
+
+    if (info->report != NULL)
+        info->report(info, 1, 0, score, &pv);
+
+    return move;
+}
+
+/**
+ * Searches the board with iterative deepening until the limits in info are
+ * reached or info->stop is set, and returns the best move. The search is run
+ * on info->num_threads threads sharing the transposition table. With
+ * info->multi_pv lines, every iteration searches the best line, then the best
+ * line without the moves of the lines before it, and so on.
+ **/
+Move search_position(SearchInfo *info, ChessBoard *board)
+{
+    int num_threads = (info->num_threads > 0) ? info->num_threads : 1;
+
+    // Positions of the endgame tables are played from the tables without searching
+    Move table_move;
+    TablebaseWdl wdl;
+    int plies;
+    bool table_hit = tablebase_root_move(board, &table_move, &wdl, &plies);
+    if (table_hit)
+        num_threads = 1;
+
+    atomic_store(&info->nodes, 0);
+    atomic_store(&info->start_time, search_time());
+    info->time_budget = allocate_time(&info->limits, board->current_color);
+    table_new_search(info->table);
+
+    SearchThread *threads = malloc(num_threads * sizeof(SearchThread));
+    pthread_t *helpers = malloc(num_threads * sizeof(pthread_t));
+    if (threads == NULL || helpers == NULL)
+    {
+        free(threads);
+        free(helpers);
+        return NULL_MOVE;
+    }
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        threads[i].info = info;
+        threads[i].board = *board;
+        threads[i].id = i;
+        threads[i].ply = 0;
+        threads[i].nodes = 0;
+        threads[i].flushed_nodes = 0;
+        threads[i].pv[0].size = 0;
+        threads[i].num_excluded = 0;
+    }
+
+    TraceEvent(TRACE_SEARCH_START, num_threads);
+
+    Move best_move;
+    if (table_hit)
+    {
+        best_move = report_table_move(info, table_move, wdl, plies);
+    }
+    else
+    {
+        for (int i = 1; i < num_threads; i++)
+            pthread_create(&helpers[i], NULL, helper_thread_main, &threads[i]);
+
+        best_move = iterative_deepening(&threads[0]);
+        StatsMerge();
+    }
+
+    // An infinite or ponder search only ends when it is told to stop
+    while ((info->limits.infinite || atomic_load(&info->pondering)) && !atomic_load(&info->stop))
+    {
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+    }
+
+    atomic_store(&info->stop, true);
+    for (int i = 1; i < num_threads; i++)
+        pthread_join(helpers[i], NULL);
+
+    for (int i = 0; i < num_threads; i++)
+        flush_nodes(&threads[i]);
+
+    TraceEvent(TRACE_SEARCH_END, 0);
+
+    // Falls back to the first legal move if not even one iteration completed
+    if (IsNullMove(best_move))
+    {
+        MoveList list;
+        chessboard_generate_moves(board, &list);
+        for (int i = 0; i < list.size && IsNullMove(best_move); i++)
+        {
+            if (chessboard_make_move(board, list.moves[i]))
             {
                 best_move = list.moves[i];
-                best_score = new_score;
+                chessboard_undo_move(board);
             }
-
-            chessboard_undo_move(board);
         }
     }
 
-    printf("Best score %i\n", best_score);
+    free(threads);
+    free(helpers);
 
     return best_move;
-}
\ No newline at end of file
+}
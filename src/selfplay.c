@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "selfplay.h"
+#include "search.h"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define BUFFER_SIZE 4096
+#define EVAL_CACHE_SIZE (1 << 16)
+#define PROGRESS_INTERVAL 5000
+
+typedef struct
+{
+    SelfplayOptions *options;
+    PackedWriter *writer;
+    pthread_mutex_t writer_mutex;
+    bool write_failed;
+
+    atomic_ullong next_game;
+    atomic_ullong num_games;
+    atomic_ullong num_positions;
+} Generator;
+
+typedef struct
+{
+    // First member so the report callback can get back to the worker from its SearchInfo
+    SearchInfo info;
+    int score;
+
+    ChessBoard board;
+    Generator *generator;
+    pthread_t thread;
+    U64 random_state;
+
+    // Records of the game in progress, which still lack the result
+    SelfplayRecord game_records[SELFPLAY_MAX_PLIES];
+    int num_game_records;
+
+    SelfplayRecord buffer[BUFFER_SIZE];
+    int buffer_size;
+} Worker;
+
+/**
+ * Returns a pseudo random number using xorshift64.
+ **/
+static U64 random_number(Worker *worker)
+{
+    worker->random_state ^= worker->random_state << 13;
+    worker->random_state ^= worker->random_state >> 7;
+    worker->random_state ^= worker->random_state << 17;
+
+    return worker->random_state;
+}
+
+/**
+ * Keeps the score of the last completed iteration.
+ **/
+static void record_iteration(SearchInfo *info, int depth, int line, int score, PrincipalVariation *pv)
+{
+    ((Worker *) info)->score = score;
+}
+
+/**
+ * Returns whether the side to move is in check.
+ **/
+static bool in_check(ChessBoard *board)
+{
+    BitBoard king = board->pieces[(board->current_color == WHITE) ? WHITE_KING : BLACK_KING];
+
+    return chessboard_squared_attacked(board, bitboard_scan_forward(king));
+}
+
+/**
+ * Plays random legal moves from the initial position. Returns false if the
+ * game ended during the opening.
+ **/
+static bool play_opening(Worker *worker)
+{
+    chessboard_init(&worker->board, START_FEN);
+
+    for (int ply = 0; ply < worker->generator->options->random_plies; ply++)
+    {
+        MoveList list;
+        Move legal_moves[256];
+        int num_legal_moves = 0;
+
+        chessboard_generate_moves(&worker->board, &list);
+        for (int i = 0; i < list.size; i++)
+        {
+            if (chessboard_make_move(&worker->board, list.moves[i]))
+            {
+                legal_moves[num_legal_moves++] = list.moves[i];
+                chessboard_undo_move(&worker->board);
+            }
+        }
+
+        if (num_legal_moves == 0)
+            return false;
+
+        chessboard_make_move(&worker->board, legal_moves[random_number(worker) % num_legal_moves]);
+    }
+
+    return true;
+}
+
+/**
+ * Hands the thread's buffer to the output container.
+ **/
+static void flush_buffer(Worker *worker)
+{
+    Generator *generator = worker->generator;
+
+    pthread_mutex_lock(&generator->writer_mutex);
+    for (int i = 0; i < worker->buffer_size && !generator->write_failed; i++)
+        generator->write_failed = !packed_writer_add(generator->writer, &worker->buffer[i]);
+    pthread_mutex_unlock(&generator->writer_mutex);
+
+    worker->buffer_size = 0;
+}
+
+/**
+ * Labels the records of the finished game with its result and moves them into
+ * the thread's buffer.
+ **/
+static void finish_game(Worker *worker, int result)
+{
+    for (int i = 0; i < worker->num_game_records; i++)
+    {
+        worker->game_records[i].result = result;
+        worker->buffer[worker->buffer_size++] = worker->game_records[i];
+
+        if (worker->buffer_size == BUFFER_SIZE)
+            flush_buffer(worker);
+    }
+
+    atomic_fetch_add(&worker->generator->num_positions, worker->num_game_records);
+    atomic_fetch_add(&worker->generator->num_games, 1);
+}
+
+/**
+ * Plays one game against itself and records its quiet positions. Returns the
+ * result from white's point of view.
+ **/
+static int play_game(Worker *worker)
+{
+    ChessBoard *board = &worker->board;
+    SelfplayOptions *options = worker->generator->options;
+
+    while (!play_opening(worker));
+
+    table_clear(worker->info.table, 1);
+    worker->num_game_records = 0;
+
+    int winning_plies = 0;
+    for (int ply = 0; ply < SELFPLAY_MAX_PLIES; ply++)
+    {
+        if (chessboard_is_draw(board))
+            return 0;
+        if (board->occupied_squares == (board->pieces[WHITE_KING] | board->pieces[BLACK_KING]))
+            return 0;
+
+        worker->score = 0;
+        worker->info.limits = (SearchLimits) {.nodes = options->nodes};
+        atomic_store(&worker->info.stop, false);
+        atomic_store(&worker->info.pondering, false);
+
+        Move move = search_position(&worker->info, board);
+        int white_score = (board->current_color == WHITE) ? worker->score : -worker->score;
+        bool check = in_check(board);
+
+        // Mate or stalemate
+        if (IsNullMove(move))
+            return check ? ((board->current_color == WHITE) ? -1 : 1) : 0;
+
+        if (!check && chessboard_captured_piece(board, move) == EMPTY && MoveType(move) < ROOK_PROMOTION && !IsMateScore(worker->score))
+        {
+            SelfplayRecord *record = &worker->game_records[worker->num_game_records];
+            if (packed_encode(board, &record->position))
+            {
+                record->score = white_score;
+                record->best_move = move;
+                worker->num_game_records++;
+            }
+        }
+
+        // Adjudicates once both sides keep seeing the same color winning, counting white's plies up and black's down
+        if (white_score >= SELFPLAY_WIN_SCORE)
+            winning_plies = (winning_plies > 0) ? winning_plies + 1 : 1;
+        else if (white_score <= -SELFPLAY_WIN_SCORE)
+            winning_plies = (winning_plies < 0) ? winning_plies - 1 : -1;
+        else
+            winning_plies = 0;
+
+        if (abs(winning_plies) >= SELFPLAY_WIN_PLIES)
+            return (winning_plies > 0) ? 1 : -1;
+
+        chessboard_make_move(board, move);
+    }
+
+    return 0;
+}
+
+/**
+ * Entry point of the threads, which play games until enough have been claimed.
+ **/
+static void* worker_main(void *arg)
+{
+    Worker *worker = arg;
+    Generator *generator = worker->generator;
+
+    U64 game;
+    while ((game = atomic_fetch_add(&generator->next_game, 1)) < generator->options->num_games)
+    {
+        // Seeds every game on its own so it does not depend on the thread playing it
+        worker->random_state = (generator->options->seed + game + 1) * 0x9e3779b97f4a7c15;
+
+        finish_game(worker, play_game(worker));
+    }
+
+    flush_buffer(worker);
+
+    return NULL;
+}
+
+/**
+ * Plays the given number of self-play games and writes their records to a
+ * container file, reporting progress and positions per second per core to
+ * stderr. Returns false if the file or the threads could not be created.
+ **/
+bool selfplay_run(char *filename, SelfplayOptions *options)
+{
+    int num_threads = (options->num_threads > 0) ? options->num_threads : 1;
+    int hash_size = (options->hash_size > 0) ? options->hash_size : SELFPLAY_HASH;
+
+    Generator generator = {
+        .options = options,
+        .writer = packed_writer_open(filename, sizeof(SelfplayRecord), PACKED_COMPRESSED),
+        .writer_mutex = PTHREAD_MUTEX_INITIALIZER,
+    };
+
+    Worker *workers = calloc(num_threads, sizeof(Worker));
+    if (generator.writer == NULL || workers == NULL)
+    {
+        if (generator.writer != NULL)
+            packed_writer_close(generator.writer);
+        free(workers);
+        return false;
+    }
+
+    bool success = true;
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers[i].generator = &generator;
+        workers[i].info.num_threads = 1;
+        workers[i].info.report = record_iteration;
+        workers[i].info.table = table_init((U64) hash_size * 1024 * 1024 / sizeof(Entry));
+        workers[i].info.eval_cache = eval_cache_init(EVAL_CACHE_SIZE);
+
+        success = success && workers[i].info.table != NULL && workers[i].info.eval_cache != NULL;
+    }
+
+    long start_time = search_time();
+
+    for (int i = 0; success && i < num_threads; i++)
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+
+    // Reports progress until every game has been played
+    long last_report = 0;
+    while (success && atomic_load(&generator.num_games) < options->num_games)
+    {
+        struct timespec delay = {0, 100000000};
+        nanosleep(&delay, NULL);
+
+        long time = search_time() - start_time;
+        if (time - last_report >= PROGRESS_INTERVAL)
+        {
+            U64 positions = atomic_load(&generator.num_positions);
+            fprintf(stderr, "Games %llu/%llu, positions %llu, %.1f positions/second\n",
+                (unsigned long long) atomic_load(&generator.num_games),
+                (unsigned long long) options->num_games,
+                (unsigned long long) positions,
+                positions * 1000.0 / time);
+            last_report = time;
+        }
+    }
+
+    for (int i = 0; success && i < num_threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    long time = search_time() - start_time;
+    if (time <= 0)
+        time = 1;
+
+    U64 positions = atomic_load(&generator.num_positions);
+    if (success)
+    {
+        fprintf(stderr, "Played %llu games with %i threads in %li ms: %llu positions, %.1f positions/second, %.1f positions/second/core\n",
+            (unsigned long long) atomic_load(&generator.num_games),
+            num_threads,
+            time,
+            (unsigned long long) positions,
+            positions * 1000.0 / time,
+            positions * 1000.0 / time / num_threads);
+    }
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        table_free(workers[i].info.table);
+        eval_cache_free(workers[i].info.eval_cache);
+    }
+    free(workers);
+
+    success = packed_writer_close(generator.writer) && success && !generator.write_failed;
+
+    return success;
+}
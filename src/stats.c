@@ -0,0 +1,88 @@
+#include "stats.h"
+
+#ifdef ENABLE_STATS
+
+#include <string.h>
+#include <pthread.h>
+
+_Thread_local Stats thread_stats;
+
+static Stats total_stats;
+static pthread_mutex_t total_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char *PHASE_NAMES[NUM_PHASES] = {
+    "generate_moves",
+    "make_move",
+    "undo_move",
+    "evaluation",
+    "table_probe",
+    "table_store",
+};
+
+/**
+ * Adds the calling thread's stats to the global totals and clears them.
+ **/
+void stats_merge(void)
+{
+    pthread_mutex_lock(&total_stats_mutex);
+
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        total_stats.calls[phase] += thread_stats.calls[phase];
+        total_stats.cycles[phase] += thread_stats.cycles[phase];
+    }
+    for (int i = 0; i < MAX_CUTOFF_INDEX; i++)
+        total_stats.cutoffs[i] += thread_stats.cutoffs[i];
+
+    total_stats.illegal_moves += thread_stats.illegal_moves;
+    total_stats.table_hits += thread_stats.table_hits;
+    total_stats.table_misses += thread_stats.table_misses;
+    total_stats.eval_cache_hits += thread_stats.eval_cache_hits;
+    total_stats.eval_cache_misses += thread_stats.eval_cache_misses;
+    total_stats.table_move_cutoffs += thread_stats.table_move_cutoffs;
+
+    pthread_mutex_unlock(&total_stats_mutex);
+
+    memset(&thread_stats, 0, sizeof(Stats));
+}
+
+/**
+ * Prints the global totals as JSON to the given file and clears them.
+ **/
+void stats_dump(FILE *file)
+{
+    pthread_mutex_lock(&total_stats_mutex);
+
+    fprintf(file, "{\"phases\": {");
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        U64 calls = total_stats.calls[phase], cycles = total_stats.cycles[phase];
+
+        fprintf(file, "%s\"%s\": {\"calls\": %llu, \"cycles\": %llu, \"cycles_per_call\": %.2f}",
+            (phase > 0) ? ", " : "",
+            PHASE_NAMES[phase],
+            (unsigned long long) calls,
+            (unsigned long long) cycles,
+            (calls > 0) ? (double) cycles / calls : 0.0);
+    }
+
+    fprintf(file, "}, \"illegal_moves\": %llu, \"table_hits\": %llu, \"table_misses\": %llu, "
+        "\"eval_cache_hits\": %llu, \"eval_cache_misses\": %llu, "
+        "\"table_move_cutoffs\": %llu, \"cutoffs_by_move_index\": [",
+        (unsigned long long) total_stats.illegal_moves,
+        (unsigned long long) total_stats.table_hits,
+        (unsigned long long) total_stats.table_misses,
+        (unsigned long long) total_stats.eval_cache_hits,
+        (unsigned long long) total_stats.eval_cache_misses,
+        (unsigned long long) total_stats.table_move_cutoffs);
+    for (int i = 0; i < MAX_CUTOFF_INDEX; i++)
+        fprintf(file, "%s%llu", (i > 0) ? ", " : "", (unsigned long long) total_stats.cutoffs[i]);
+    fprintf(file, "]}\n");
+    fflush(file);
+
+    memset(&total_stats, 0, sizeof(Stats));
+
+    pthread_mutex_unlock(&total_stats_mutex);
+}
+
+#endif
@@ -0,0 +1,1111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tablebase.h"
+#include "lookup_tables.h"
+#include "magic_bitboard.h"
+#include "search.h"
+
+#define HEADER_SIZE 32
+#define DTM_MAGIC "CETBDTM1"
+#define WDL_MAGIC "CETBWDL1"
+
+#define UNKNOWN 0
+#define INVALID 255
+#define MAX_PLIES 253
+
+// Stored as the longest loss through a move leaving the table if one of them draws
+#define DRAW_EXIT 255
+
+#define CHUNK_SIZE 4096
+#define MAX_GENERATOR_THREADS 256
+#define WRITE_BUFFER_SIZE 65536
+
+#define Rank(square) ((square) / 8)
+#define File(square) ((square) % 8)
+#define Transpose(square) ((((square) & 7) << 3) | ((square) >> 3))
+
+#define SwapColor(piece) (((piece) < BLACK_PAWNS) ? (piece) + 6 : (piece) - 6)
+#define MaterialUnit(piece) ((U64) 1 << (4 * ((piece) - WHITE_PAWNS)))
+#define MaterialCount(material, piece) (((material) >> (4 * ((piece) - WHITE_PAWNS))) & 0xf)
+
+// Such tables would score double pushes as if the en passent reply did not exist
+#define PawnsOnBothSides(material) (MaterialCount(material, WHITE_PAWNS) && MaterialCount(material, BLACK_PAWNS))
+
+typedef struct
+{
+    Tablebase *table;
+
+    // Value of every position in the .dtm encoding, UNKNOWN until resolved
+    atomic_uchar *values;
+
+    // Number of distinct positions in the table a move leads to that are not yet known to win
+    atomic_uchar *counters;
+
+    // Plies of the shortest win and the longest loss through moves leaving the table, 0 if none
+    U8 *exit_wins;
+    U8 *exit_losses;
+
+    int num_threads;
+    int ply;
+    atomic_ullong next_chunk;
+    atomic_int max_ply;
+    atomic_bool overflow;
+    atomic_bool missing_table;
+} Generator;
+
+/**
+ * Resolves the given position (side to move times table size plus index)
+ * using the board as scratch space.
+ **/
+typedef void (*GeneratorPass)(Generator *generator, ChessBoard *board, U64 position);
+
+typedef struct
+{
+    Generator *generator;
+    GeneratorPass pass;
+} PassThread;
+
+// Pieces after the kings, in index order
+static const Piece PIECE_ORDER[] = {WHITE_QUEENS, WHITE_ROOKS, WHITE_BISHOPS, WHITE_KNIGHTS, WHITE_PAWNS};
+static const char PIECE_LETTERS[] = "QRBNP";
+
+// Squares of the a1-d1-d4 triangle the white king is mapped into without pawns
+static const int TRIANGLE_SQUARES[10] = {A1, B1, C1, D1, B2, C2, D2, C3, D3, D4};
+static const int TRIANGLE_INDEX[64] = {
+    0, 1, 2, 3, -1, -1, -1, -1,
+    -1, 4, 5, 6, -1, -1, -1, -1,
+    -1, -1, 7, 8, -1, -1, -1, -1,
+    -1, -1, -1, 9, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static Tablebase tables[TABLEBASE_MAX_TABLES];
+static int num_tables;
+static int max_pieces;
+
+/**
+ * Returns the material of the board.
+ **/
+static U64 board_material(ChessBoard *board)
+{
+    U64 material = 0;
+    for (Piece piece = WHITE_PAWNS; piece <= BLACK_QUEENS; piece++)
+    {
+        if (piece != WHITE_KING)
+            material |= (U64) bitboard_count(board->pieces[piece]) << (4 * (piece - WHITE_PAWNS));
+    }
+
+    return material;
+}
+
+/**
+ * Returns the material with the colors swapped.
+ **/
+static U64 swap_material(U64 material)
+{
+    U64 swapped = 0;
+    for (Piece piece = WHITE_PAWNS; piece <= BLACK_QUEENS; piece++)
+    {
+        if (piece != WHITE_KING)
+            swapped |= MaterialCount(material, piece) * MaterialUnit(SwapColor(piece));
+    }
+
+    return swapped;
+}
+
+/**
+ * Returns whether black has the stronger pieces, comparing the number of
+ * queens, then rooks and so on down to pawns.
+ **/
+static bool black_stronger(U64 material)
+{
+    for (int i = 0; i < 5; i++)
+    {
+        int white = MaterialCount(material, PIECE_ORDER[i]);
+        int black = MaterialCount(material, SwapColor(PIECE_ORDER[i]));
+        if (white != black)
+            return black > white;
+    }
+
+    return false;
+}
+
+/**
+ * Writes the name of the material (e.g. KRvK) into the buffer.
+ **/
+static void material_name(U64 material, char *name)
+{
+    for (int color = WHITE; color <= BLACK; color++)
+    {
+        if (color == BLACK)
+            *name++ = 'v';
+        *name++ = 'K';
+
+        for (int i = 0; i < 5; i++)
+        {
+            Piece piece = (color == WHITE) ? PIECE_ORDER[i] : SwapColor(PIECE_ORDER[i]);
+            for (int count = MaterialCount(material, piece); count > 0; count--)
+                *name++ = PIECE_LETTERS[i];
+        }
+    }
+
+    *name = '\0';
+}
+
+/**
+ * Parses a material name such as KQvKR. Returns false if it is malformed, has
+ * too many pieces or has pawns on both sides.
+ **/
+static bool parse_material(char *name, U64 *material)
+{
+    int color = WHITE, num_pieces = 1;
+    *material = 0;
+
+    if (toupper(*name++) != 'K')
+        return false;
+
+    for (; *name != '\0'; name++)
+    {
+        char c = toupper(*name);
+        if (c == 'V' && color == WHITE && toupper(name[1]) == 'K')
+        {
+            color = BLACK;
+            num_pieces++;
+            name++;
+            continue;
+        }
+
+        char *letter = strchr(PIECE_LETTERS, c);
+        if (letter == NULL)
+            return false;
+
+        Piece piece = PIECE_ORDER[letter - PIECE_LETTERS];
+        *material += MaterialUnit((color == WHITE) ? piece : SwapColor(piece));
+        num_pieces++;
+    }
+
+    return color == BLACK && num_pieces <= TABLEBASE_MAX_PIECES && !PawnsOnBothSides(*material);
+}
+
+/**
+ * Fills in the layout of the table of the material, whose stronger side must
+ * be white.
+ **/
+static void init_table(Tablebase *table, U64 material)
+{
+    memset(table, 0, sizeof(Tablebase));
+    material_name(material, table->name);
+    table->material = material;
+
+    table->pieces[table->num_pieces++] = WHITE_KING;
+    table->pieces[table->num_pieces++] = BLACK_KING;
+    for (int color = WHITE; color <= BLACK; color++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            Piece piece = (color == WHITE) ? PIECE_ORDER[i] : SwapColor(PIECE_ORDER[i]);
+            for (int count = MaterialCount(material, piece); count > 0; count--)
+                table->pieces[table->num_pieces++] = piece;
+        }
+    }
+
+    table->has_pawns = MaterialCount(material, WHITE_PAWNS) || MaterialCount(material, BLACK_PAWNS);
+    table->size = table->has_pawns ? 32 : 10;
+    for (int i = 1; i < table->num_pieces; i++)
+        table->size *= 64;
+}
+
+/**
+ * Returns the index of the squares, whose white king must already be in its
+ * region. Identical pieces are sorted by square first.
+ **/
+static U64 squares_index(Tablebase *table, int *squares)
+{
+    for (int i = 3; i < table->num_pieces; i++)
+    {
+        for (int j = i; j > 2 && table->pieces[j - 1] == table->pieces[j] && squares[j - 1] > squares[j]; j--)
+        {
+            int square = squares[j];
+            squares[j] = squares[j - 1];
+            squares[j - 1] = square;
+        }
+    }
+
+    U64 index = table->has_pawns ? Rank(squares[0]) * 4 + File(squares[0]) : TRIANGLE_INDEX[squares[0]];
+    for (int i = 1; i < table->num_pieces; i++)
+        index = index * 64 + squares[i];
+
+    return index;
+}
+
+/**
+ * Returns the index of the position given by the square of every piece of the
+ * table, which is the same for all of its symmetric positions.
+ **/
+static U64 position_index(Tablebase *table, int *position)
+{
+    int squares[TABLEBASE_MAX_PIECES];
+    int king = position[0];
+
+    if (table->has_pawns)
+    {
+        for (int i = 0; i < table->num_pieces; i++)
+            squares[i] = position[i] ^ ((File(king) > FILE_D) ? 7 : 0);
+
+        return squares_index(table, squares);
+    }
+
+    int flip = ((File(king) > FILE_D) ? 7 : 0) | ((Rank(king) > RANK_4) ? 56 : 0);
+    bool transpose = Rank(king ^ flip) > File(king ^ flip);
+    for (int i = 0; i < table->num_pieces; i++)
+        squares[i] = transpose ? Transpose(position[i] ^ flip) : position[i] ^ flip;
+
+    U64 index = squares_index(table, squares);
+
+    // Transposing keeps a king on the diagonal in the triangle, so both indices are candidates
+    if (Rank(squares[0]) == File(squares[0]))
+    {
+        for (int i = 0; i < table->num_pieces; i++)
+            squares[i] = Transpose(squares[i]);
+
+        U64 transposed = squares_index(table, squares);
+        if (transposed < index)
+            index = transposed;
+    }
+
+    return index;
+}
+
+/**
+ * Fills squares with the square of every piece of the index.
+ **/
+static void index_squares(Tablebase *table, U64 index, int *squares)
+{
+    for (int i = table->num_pieces - 1; i > 0; i--)
+    {
+        squares[i] = index % 64;
+        index /= 64;
+    }
+
+    squares[0] = table->has_pawns ? (index / 4) * 8 + index % 4 : TRIANGLE_SQUARES[index];
+}
+
+/**
+ * Fills squares with the square of every piece of the table on the board,
+ * mirroring the board and swapping the colors if flip is set.
+ **/
+static void board_squares(Tablebase *table, ChessBoard *board, bool flip, int *squares)
+{
+    BitBoard pieces[14];
+    memcpy(pieces, board->pieces, sizeof(pieces));
+
+    for (int i = 0; i < table->num_pieces; i++)
+    {
+        Piece piece = flip ? SwapColor(table->pieces[i]) : table->pieces[i];
+        squares[i] = bitboard_pop(&pieces[piece]) ^ (flip ? 56 : 0);
+    }
+}
+
+/**
+ * Returns the table of the board and sets the position of the board in it.
+ * Returns NULL if the board is not in a table.
+ **/
+static Tablebase* find_position(ChessBoard *board, U64 *position)
+{
+    if (num_tables == 0 || board->castle_permission
+        || bitboard_count(board->occupied_squares) > max_pieces)
+        return NULL;
+
+    // En passent rights only matter if the side to move can capture
+    if (board->en_passent)
+    {
+        int square = bitboard_scan_forward(board->en_passent);
+        Piece pawns = (board->current_color == WHITE) ? WHITE_PAWNS : BLACK_PAWNS;
+
+        if (MASK_PAWN_ATTACKS[!board->current_color][square] & board->pieces[pawns])
+            return NULL;
+    }
+
+    U64 material = board_material(board), swapped = swap_material(material);
+    for (int i = 0; i < num_tables; i++)
+    {
+        if (tables[i].material != material && tables[i].material != swapped)
+            continue;
+
+        // Symmetric material is never flipped
+        bool flip = tables[i].material != material;
+        int squares[TABLEBASE_MAX_PIECES];
+
+        board_squares(&tables[i], board, flip, squares);
+        *position = (board->current_color ^ flip) * tables[i].size + position_index(&tables[i], squares);
+
+        return &tables[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns the .dtm value of the board's position, or -1 if it is not in a table.
+ **/
+static int probe_value(ChessBoard *board)
+{
+    U64 position;
+    Tablebase *table = find_position(board, &position);
+
+    return (table != NULL) ? table->dtm[position] : -1;
+}
+
+/**
+ * Converts a .dtm value into the result and plies to mate of the side to move.
+ **/
+static void value_result(int value, TablebaseWdl *wdl, int *plies)
+{
+    *plies = (value == UNKNOWN || value == INVALID) ? 0 : value - 1;
+    *wdl = (value == UNKNOWN) ? TABLEBASE_DRAW
+        : (value == INVALID) ? TABLEBASE_INVALID
+        : (*plies % 2) ? TABLEBASE_WIN
+        : TABLEBASE_LOSS;
+}
+
+/**
+ * Probes the WDL tables. Returns false if the position is not in a table,
+ * otherwise sets wdl to the result for the side to move.
+ **/
+bool tablebase_probe_wdl(ChessBoard *board, TablebaseWdl *wdl)
+{
+    U64 position;
+    Tablebase *table = find_position(board, &position);
+    if (table == NULL)
+        return false;
+
+    *wdl = (table->wdl[position / 4] >> (2 * (position % 4))) & 3;
+
+    return *wdl != TABLEBASE_INVALID;
+}
+
+/**
+ * Probes the DTM tables. Returns false if the position is not in a table,
+ * otherwise sets wdl to the result for the side to move and plies to the
+ * number of plies to mate (0 for draws).
+ **/
+bool tablebase_probe_dtm(ChessBoard *board, TablebaseWdl *wdl, int *plies)
+{
+    int value = probe_value(board);
+    if (value < 0)
+        return false;
+
+    value_result(value, wdl, plies);
+
+    return *wdl != TABLEBASE_INVALID;
+}
+
+/**
+ * Chooses the legal move that mates fastest, keeps a draw or delays mate the
+ * longest. Returns false if the position or one of its moves is not in a
+ * table, otherwise sets move and the result of the position as
+ * tablebase_probe_dtm.
+ **/
+bool tablebase_root_move(ChessBoard *board, Move *move, TablebaseWdl *wdl, int *plies)
+{
+    if (probe_value(board) < 0)
+        return false;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    // Ranks the results from the fastest win down to the fastest loss
+    int best_rank = -INFINITE_SCORE;
+    for (int i = 0; i < list.size; i++)
+    {
+        if (!chessboard_make_move(board, list.moves[i]))
+            continue;
+
+        int value = probe_value(board);
+        chessboard_undo_move(board);
+
+        TablebaseWdl child_wdl;
+        int child_plies;
+        if (value < 0 || value == INVALID)
+            return false;
+        value_result(value, &child_wdl, &child_plies);
+
+        int rank = (child_wdl == TABLEBASE_LOSS) ? MAX_PLIES + 1 - child_plies
+            : (child_wdl == TABLEBASE_WIN) ? child_plies - MAX_PLIES - 1
+            : 0;
+        if (rank > best_rank)
+        {
+            best_rank = rank;
+            *move = list.moves[i];
+            *wdl = (child_wdl == TABLEBASE_DRAW) ? TABLEBASE_DRAW : TABLEBASE_WIN - child_wdl;
+            *plies = (child_wdl == TABLEBASE_DRAW) ? 0 : child_plies + 1;
+        }
+    }
+
+    return best_rank != -INFINITE_SCORE;
+}
+
+/**
+ * Memory maps the file if it starts with the given magic and holds the data of
+ * the table. Returns NULL otherwise.
+ **/
+static U8* map_file(char *filename, char *magic, Tablebase *table, U64 data_size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat file_stat;
+    U8 *file = MAP_FAILED;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size == HEADER_SIZE + data_size)
+        file = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (file == MAP_FAILED)
+        return NULL;
+
+    U64 size;
+    memcpy(&size, file + 24, sizeof(size));
+    if (memcmp(file, magic, 8) != 0 || strncmp((char *) file + 8, table->name, 16) != 0 || size != table->size)
+    {
+        munmap(file, HEADER_SIZE + data_size);
+        return NULL;
+    }
+
+    return file;
+}
+
+/**
+ * Maps the files of the material's table from the directory. Returns false if
+ * they are missing or corrupt.
+ **/
+static bool load_table(char *directory, U64 material)
+{
+    if (num_tables == TABLEBASE_MAX_TABLES)
+        return false;
+
+    Tablebase *table = &tables[num_tables];
+    init_table(table, material);
+
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/%s.dtm", directory, table->name);
+    table->dtm_file = map_file(filename, DTM_MAGIC, table, 2 * table->size);
+
+    snprintf(filename, sizeof(filename), "%s/%s.wdl", directory, table->name);
+    table->wdl_file = map_file(filename, WDL_MAGIC, table, (2 * table->size + 3) / 4);
+
+    if (table->dtm_file == NULL || table->wdl_file == NULL)
+    {
+        if (table->dtm_file != NULL)
+            munmap(table->dtm_file, HEADER_SIZE + 2 * table->size);
+        if (table->wdl_file != NULL)
+            munmap(table->wdl_file, HEADER_SIZE + (2 * table->size + 3) / 4);
+        return false;
+    }
+
+    table->dtm = table->dtm_file + HEADER_SIZE;
+    table->wdl = table->wdl_file + HEADER_SIZE;
+
+    num_tables++;
+    if (table->num_pieces > max_pieces)
+        max_pieces = table->num_pieces;
+
+    return true;
+}
+
+/**
+ * Returns whether the table of the material is mapped.
+ **/
+static bool table_loaded(U64 material)
+{
+    for (int i = 0; i < num_tables; i++)
+    {
+        if (tables[i].material == material)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Maps every table found in the directory, replacing the tables mapped before.
+ * Returns the number of tables mapped.
+ **/
+int tablebase_init(char *directory)
+{
+    tablebase_free();
+
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+        return 0;
+
+    struct dirent *file;
+    while ((file = readdir(dir)) != NULL)
+    {
+        char name[256];
+        U64 material;
+
+        char *extension = strrchr(file->d_name, '.');
+        if (extension == NULL || strcmp(extension, ".dtm") != 0 || extension - file->d_name >= sizeof(name))
+            continue;
+
+        memcpy(name, file->d_name, extension - file->d_name);
+        name[extension - file->d_name] = '\0';
+
+        if (parse_material(name, &material) && !black_stronger(material) && !table_loaded(material))
+            load_table(directory, material);
+    }
+
+    closedir(dir);
+
+    return num_tables;
+}
+
+/**
+ * Unmaps every table.
+ **/
+void tablebase_free(void)
+{
+    for (int i = 0; i < num_tables; i++)
+    {
+        munmap(tables[i].dtm_file, HEADER_SIZE + 2 * tables[i].size);
+        munmap(tables[i].wdl_file, HEADER_SIZE + (2 * tables[i].size + 3) / 4);
+    }
+
+    num_tables = 0;
+    max_pieces = 0;
+}
+
+/**
+ * Places the pieces on the board with the given side to move.
+ **/
+static void setup_board(ChessBoard *board, Tablebase *table, int *squares, int color)
+{
+    memset(board->pieces, 0, sizeof(board->pieces));
+    for (int i = 0; i < table->num_pieces; i++)
+    {
+        board->pieces[table->pieces[i]] |= MASK_SQUARE[squares[i]];
+        board->pieces[PieceColor(table->pieces[i])] |= MASK_SQUARE[squares[i]];
+    }
+
+    board->occupied_squares = board->pieces[WHITE] | board->pieces[BLACK];
+    board->empty_squares = ~board->occupied_squares;
+    board->en_passent = 0;
+    board->castle_permission = 0;
+    board->current_color = color;
+    board->num_moves = 0;
+    board->position_key = 0;
+    memset(board->repetition_filter, 0, sizeof(board->repetition_filter));
+}
+
+/**
+ * Returns whether the squares are a position of the table: no two pieces on
+ * the same square, no pawns on the first or last rank, no adjacent kings and
+ * the smallest index among the symmetric positions.
+ **/
+static bool valid_squares(Tablebase *table, int *squares, U64 index)
+{
+    BitBoard occupied = 0;
+    for (int i = 0; i < table->num_pieces; i++)
+    {
+        if (occupied & MASK_SQUARE[squares[i]])
+            return false;
+        occupied |= MASK_SQUARE[squares[i]];
+
+        bool pawn = table->pieces[i] == WHITE_PAWNS || table->pieces[i] == BLACK_PAWNS;
+        if (pawn && (Rank(squares[i]) == RANK_1 || Rank(squares[i]) == RANK_8))
+            return false;
+    }
+
+    if (MASK_KING_ATTACKS[squares[0]] & MASK_SQUARE[squares[1]])
+        return false;
+
+    return position_index(table, squares) == index;
+}
+
+/**
+ * Stores the plies to mate of an unresolved position.
+ **/
+static void resolve(Generator *generator, U64 position, int plies)
+{
+    if (plies > MAX_PLIES)
+    {
+        atomic_store(&generator->overflow, true);
+        return;
+    }
+
+    U8 expected = UNKNOWN;
+    if (!atomic_compare_exchange_strong(&generator->values[position], &expected, plies + 1))
+        return;
+
+    int max_ply = atomic_load(&generator->max_ply);
+    while (plies > max_ply && !atomic_compare_exchange_weak(&generator->max_ply, &max_ply, plies));
+}
+
+/**
+ * Marks invalid positions, resolves mates, stalemates and positions whose
+ * moves all leave the table, and counts the moves of the others.
+ **/
+static void initialize_position(Generator *generator, ChessBoard *board, U64 position)
+{
+    Tablebase *table = generator->table;
+    int color = position >= table->size;
+    U64 index = position - color * table->size;
+
+    int squares[TABLEBASE_MAX_PIECES];
+    index_squares(table, index, squares);
+    if (!valid_squares(table, squares, index))
+    {
+        atomic_store_explicit(&generator->values[position], INVALID, memory_order_relaxed);
+        return;
+    }
+
+    // The side that just moved can not be in check
+    setup_board(board, table, squares, !color);
+    Piece king = (color == WHITE) ? BLACK_KING : WHITE_KING;
+    if (chessboard_squared_attacked(board, bitboard_scan_forward(board->pieces[king])))
+    {
+        atomic_store_explicit(&generator->values[position], INVALID, memory_order_relaxed);
+        return;
+    }
+    board->current_color = color;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    U64 children[256];
+    int num_children = 0, num_legal_moves = 0, exit_win = 0, exit_loss = 0;
+    for (int i = 0; i < list.size; i++)
+    {
+        Move move = list.moves[i];
+        bool conversion = chessboard_captured_piece(board, move) != EMPTY || MoveType(move) >= ROOK_PROMOTION;
+        if (!chessboard_make_move(board, move))
+            continue;
+
+        num_legal_moves++;
+
+        if (conversion)
+        {
+            // The child's value is from the opponent's point of view
+            int value = probe_value(board);
+            if (value < 0 || value == INVALID)
+                atomic_store(&generator->missing_table, true);
+            else if (value == UNKNOWN)
+                exit_loss = DRAW_EXIT;
+            else if ((value - 1) % 2 == 0)
+                exit_win = (exit_win == 0 || value < exit_win) ? value : exit_win;
+            else if (exit_loss != DRAW_EXIT && value > exit_loss)
+                exit_loss = value;
+        }
+        else
+        {
+            int child[TABLEBASE_MAX_PIECES];
+            board_squares(table, board, false, child);
+            U64 child_index = position_index(table, child);
+
+            // Moves to symmetric positions count once, as the unmoves find them once
+            bool duplicate = false;
+            for (int j = 0; j < num_children && !duplicate; j++)
+                duplicate = children[j] == child_index;
+            if (!duplicate)
+                children[num_children++] = child_index;
+        }
+
+        chessboard_undo_move(board);
+    }
+
+    if (exit_win > MAX_PLIES || (exit_loss != DRAW_EXIT && exit_loss > MAX_PLIES))
+        atomic_store(&generator->overflow, true);
+
+    generator->exit_wins[position] = exit_win;
+    generator->exit_losses[position] = exit_loss;
+    atomic_store_explicit(&generator->counters[position], num_children, memory_order_relaxed);
+
+    if (num_legal_moves == 0)
+    {
+        Piece own_king = (color == WHITE) ? WHITE_KING : BLACK_KING;
+        if (chessboard_squared_attacked(board, bitboard_scan_forward(board->pieces[own_king])))
+            resolve(generator, position, 0);
+    }
+    else if (num_children == 0)
+    {
+        if (exit_win)
+            resolve(generator, position, exit_win);
+        else if (exit_loss != DRAW_EXIT)
+            resolve(generator, position, exit_loss);
+    }
+    else if (exit_win)
+    {
+        // Makes sure the passes run until the win through the exit is reached
+        int max_ply = atomic_load(&generator->max_ply);
+        while (exit_win > max_ply && !atomic_compare_exchange_weak(&generator->max_ply, &max_ply, exit_win));
+    }
+}
+
+/**
+ * Returns the squares the piece standing on the given square may have come
+ * from with a move that neither captured nor promoted.
+ **/
+static BitBoard unmove_origins(Piece piece, int square, BitBoard occupied)
+{
+    BitBoard empty = ~occupied;
+
+    switch (piece)
+    {
+        case WHITE_PAWNS:
+            if (Rank(square) < RANK_3 || (occupied & MASK_SQUARE[square - 8]))
+                return 0;
+            if (Rank(square) == RANK_4 && (empty & MASK_SQUARE[square - 16]))
+                return MASK_SQUARE[square - 8] | MASK_SQUARE[square - 16];
+            return MASK_SQUARE[square - 8];
+        case BLACK_PAWNS:
+            if (Rank(square) > RANK_6 || (occupied & MASK_SQUARE[square + 8]))
+                return 0;
+            if (Rank(square) == RANK_5 && (empty & MASK_SQUARE[square + 16]))
+                return MASK_SQUARE[square + 8] | MASK_SQUARE[square + 16];
+            return MASK_SQUARE[square + 8];
+        case WHITE_KNIGHTS:
+        case BLACK_KNIGHTS:
+            return MASK_KNIGHT_ATTACKS[square] & empty;
+        case WHITE_BISHOPS:
+        case BLACK_BISHOPS:
+            return lookup_bishop_attacks(square, occupied) & empty;
+        case WHITE_ROOKS:
+        case BLACK_ROOKS:
+            return lookup_rook_attacks(square, occupied) & empty;
+        case WHITE_QUEENS:
+        case BLACK_QUEENS:
+            return lookup_queen_attacks(square, occupied) & empty;
+        default:
+            return MASK_KING_ATTACKS[square] & empty;
+    }
+}
+
+/**
+ * Propagates the positions resolved at the pass's distance to their
+ * predecessors and resolves the wins through moves leaving the table that are
+ * one ply further away.
+ **/
+static void propagate_position(Generator *generator, ChessBoard *board, U64 position)
+{
+    Tablebase *table = generator->table;
+    int ply = generator->ply;
+    int value = atomic_load_explicit(&generator->values[position], memory_order_relaxed);
+
+    if (value == UNKNOWN && generator->exit_wins[position] == ply + 1)
+        resolve(generator, position, ply + 1);
+    if (value != ply + 1)
+        return;
+
+    int color = position >= table->size;
+    int squares[TABLEBASE_MAX_PIECES];
+    index_squares(table, position - color * table->size, squares);
+
+    BitBoard occupied = 0;
+    for (int i = 0; i < table->num_pieces; i++)
+        occupied |= MASK_SQUARE[squares[i]];
+
+    // Unmoves the pieces of the side that just moved, counting every predecessor once
+    U64 predecessors[256];
+    int num_predecessors = 0;
+    for (int i = 0; i < table->num_pieces; i++)
+    {
+        if (PieceColor(table->pieces[i]) == color)
+            continue;
+
+        int square = squares[i];
+        BitBoard origins = unmove_origins(table->pieces[i], square, occupied);
+        while (origins)
+        {
+            squares[i] = bitboard_pop(&origins);
+            U64 predecessor = (!color) * table->size + position_index(table, squares);
+
+            bool duplicate = false;
+            for (int j = 0; j < num_predecessors && !duplicate; j++)
+                duplicate = predecessors[j] == predecessor;
+            if (!duplicate && num_predecessors < 256)
+                predecessors[num_predecessors++] = predecessor;
+        }
+        squares[i] = square;
+    }
+
+    for (int i = 0; i < num_predecessors; i++)
+    {
+        U64 predecessor = predecessors[i];
+
+        // A move into a loss wins
+        if (ply % 2 == 0)
+        {
+            resolve(generator, predecessor, ply + 1);
+            continue;
+        }
+
+        // A position loses once every move leads into a win and no move leaving the table saves it
+        if (atomic_load_explicit(&generator->values[predecessor], memory_order_relaxed) != UNKNOWN)
+            continue;
+        if (atomic_fetch_sub(&generator->counters[predecessor], 1) != 1)
+            continue;
+
+        int exit_loss = generator->exit_losses[predecessor];
+        if (generator->exit_wins[predecessor] == 0 && exit_loss != DRAW_EXIT)
+            resolve(generator, predecessor, (exit_loss > ply + 1) ? exit_loss : ply + 1);
+    }
+}
+
+/**
+ * Entry point of the threads running a pass over chunks of positions.
+ **/
+static void* pass_main(void *arg)
+{
+    PassThread *thread = arg;
+    Generator *generator = thread->generator;
+    U64 num_positions = 2 * generator->table->size;
+
+    ChessBoard *board = malloc(sizeof(ChessBoard));
+    if (board == NULL)
+    {
+        atomic_store(&generator->missing_table, true);
+        return NULL;
+    }
+
+    U64 start;
+    while ((start = atomic_fetch_add(&generator->next_chunk, CHUNK_SIZE)) < num_positions)
+    {
+        U64 end = (start + CHUNK_SIZE < num_positions) ? start + CHUNK_SIZE : num_positions;
+        for (U64 position = start; position < end; position++)
+            thread->pass(generator, board, position);
+    }
+
+    free(board);
+
+    return NULL;
+}
+
+/**
+ * Runs the pass over every position of the table on the generator's threads.
+ **/
+static void run_pass(Generator *generator, GeneratorPass pass)
+{
+    pthread_t handles[MAX_GENERATOR_THREADS];
+    PassThread thread = {generator, pass};
+
+    atomic_store(&generator->next_chunk, 0);
+
+    for (int i = 0; i < generator->num_threads; i++)
+        pthread_create(&handles[i], NULL, pass_main, &thread);
+    for (int i = 0; i < generator->num_threads; i++)
+        pthread_join(handles[i], NULL);
+}
+
+/**
+ * Writes the header of a table file. Returns false on write errors.
+ **/
+static bool write_header(FILE *file, char *magic, Tablebase *table)
+{
+    U8 header[HEADER_SIZE] = {0};
+    memcpy(header, magic, 8);
+    strncpy((char *) header + 8, table->name, 16);
+    memcpy(header + 24, &table->size, sizeof(table->size));
+
+    return fwrite(header, HEADER_SIZE, 1, file) == 1;
+}
+
+/**
+ * Writes the .dtm and .wdl files of the generated table. Returns false on
+ * write errors.
+ **/
+static bool write_table(char *directory, Generator *generator)
+{
+    Tablebase *table = generator->table;
+    U64 num_positions = 2 * table->size;
+    char filename[4096];
+
+    snprintf(filename, sizeof(filename), "%s/%s.dtm", directory, table->name);
+    FILE *dtm = fopen(filename, "wb");
+    snprintf(filename, sizeof(filename), "%s/%s.wdl", directory, table->name);
+    FILE *wdl = fopen(filename, "wb");
+
+    U8 *buffer = malloc(WRITE_BUFFER_SIZE);
+    bool success = dtm != NULL && wdl != NULL && buffer != NULL
+        && write_header(dtm, DTM_MAGIC, table) && write_header(wdl, WDL_MAGIC, table);
+
+    for (U64 start = 0; success && start < num_positions; start += WRITE_BUFFER_SIZE)
+    {
+        U64 size = (num_positions - start < WRITE_BUFFER_SIZE) ? num_positions - start : WRITE_BUFFER_SIZE;
+
+        for (U64 i = 0; i < size; i++)
+            buffer[i] = atomic_load_explicit(&generator->values[start + i], memory_order_relaxed);
+        success = fwrite(buffer, size, 1, dtm) == 1;
+
+        // Packs four results per byte, the buffer size being a multiple of four
+        for (U64 i = 0; i < size; i += 4)
+        {
+            U8 packed = 0;
+            for (U64 j = i; j < i + 4; j++)
+            {
+                TablebaseWdl result = TABLEBASE_INVALID;
+                int plies;
+                if (j < size)
+                    value_result(buffer[j], &result, &plies);
+
+                packed |= result << (2 * (j - i));
+            }
+            buffer[i / 4] = packed;
+        }
+        success = success && fwrite(buffer, (size + 3) / 4, 1, wdl) == 1;
+    }
+
+    free(buffer);
+    success = (dtm != NULL && fclose(dtm) == 0) && success;
+    success = (wdl != NULL && fclose(wdl) == 0) && success;
+
+    return success;
+}
+
+/**
+ * Generates the table of the material by retrograde analysis and writes it to
+ * the directory. Returns false if it could not be generated or written.
+ **/
+static bool generate_table(char *directory, Tablebase *table, int num_threads)
+{
+    Generator generator = {
+        .table = table,
+        .values = calloc(2 * table->size, sizeof(atomic_uchar)),
+        .counters = calloc(2 * table->size, sizeof(atomic_uchar)),
+        .exit_wins = calloc(2 * table->size, sizeof(U8)),
+        .exit_losses = calloc(2 * table->size, sizeof(U8)),
+        .num_threads = (num_threads < 1) ? 1 : (num_threads > MAX_GENERATOR_THREADS) ? MAX_GENERATOR_THREADS : num_threads,
+    };
+
+    bool success = generator.values != NULL && generator.counters != NULL
+        && generator.exit_wins != NULL && generator.exit_losses != NULL;
+
+    long start_time = search_time();
+
+    if (success)
+    {
+        run_pass(&generator, initialize_position);
+
+        for (generator.ply = 0; generator.ply <= atomic_load(&generator.max_ply); generator.ply++)
+            run_pass(&generator, propagate_position);
+
+        success = !atomic_load(&generator.overflow) && !atomic_load(&generator.missing_table)
+            && write_table(directory, &generator);
+    }
+
+    long time = search_time() - start_time;
+    if (success)
+    {
+        printf("Generated %s: %llu positions in %li ms, %.0f positions/second, longest mate %i plies\n",
+            table->name,
+            (unsigned long long) (2 * table->size),
+            time,
+            2 * table->size * 1000.0 / (time > 0 ? time : 1),
+            atomic_load(&generator.max_ply));
+        fflush(stdout);
+    }
+
+    free(generator.values);
+    free(generator.counters);
+    free(generator.exit_wins);
+    free(generator.exit_losses);
+
+    return success;
+}
+
+/**
+ * Maps the table of the material, generating it and the tables it depends on
+ * if they are missing from the directory.
+ **/
+static bool generate_material(char *directory, U64 material, int num_threads)
+{
+    if (black_stronger(material))
+        material = swap_material(material);
+    if (table_loaded(material) || load_table(directory, material))
+        return true;
+
+    // Captures and promotions lead into smaller tables, which must exist first
+    for (Piece piece = WHITE_PAWNS; piece <= BLACK_QUEENS; piece++)
+    {
+        if (piece == WHITE_KING || MaterialCount(material, piece) == 0)
+            continue;
+
+        U64 captured = material - MaterialUnit(piece);
+        if (!generate_material(directory, captured, num_threads))
+            return false;
+
+        if (piece != WHITE_PAWNS && piece != BLACK_PAWNS)
+            continue;
+
+        for (Piece promoted = piece + 1; promoted <= piece + 4; promoted++)
+        {
+            if (!generate_material(directory, captured + MaterialUnit(promoted), num_threads))
+                return false;
+        }
+    }
+
+    if (num_tables == TABLEBASE_MAX_TABLES)
+        return false;
+
+    Tablebase table;
+    init_table(&table, material);
+
+    return generate_table(directory, &table, num_threads) && load_table(directory, material);
+}
+
+/**
+ * Generates every table with the given number of pieces besides the kings,
+ * choosing the count of each kind from the given one on.
+ **/
+static bool generate_all(char *directory, U64 material, int num_pieces, int kind, int num_threads)
+{
+    if (num_pieces == 0)
+        return PawnsOnBothSides(material) || generate_material(directory, material, num_threads);
+
+    for (; kind < 10; kind++)
+    {
+        Piece piece = (kind < 5) ? PIECE_ORDER[kind] : SwapColor(PIECE_ORDER[kind - 5]);
+        if (!generate_all(directory, material + MaterialUnit(piece), num_pieces - 1, kind, num_threads))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Generates the table of the given material (e.g. KRvK), or every table with
+ * the given number of pieces (e.g. 4), on num_threads threads and writes it to
+ * the directory, first generating any smaller table reached by captures or
+ * promotions that is missing. Tables with pawns on both sides are skipped.
+ * Returns false if the material is not valid, has pawns on both sides, or a
+ * table could not be written.
+ **/
+bool tablebase_generate(char *directory, char *material, int num_threads)
+{
+    if (isdigit(material[0]) && material[1] == '\0')
+    {
+        int num_pieces = material[0] - '0';
+        if (num_pieces < 2 || num_pieces > TABLEBASE_MAX_PIECES)
+            return false;
+
+        return generate_all(directory, 0, num_pieces - 2, 0, num_threads);
+    }
+
+    U64 parsed;
+    if (!parse_material(material, &parsed))
+        return false;
+
+    return generate_material(directory, parsed, num_threads);
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_MAGIC "CETRACE1"
+
+#ifdef ENABLE_TRACE
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TRACE_RING_SIZE 4096
+#define MAX_TRACE_RINGS 64
+#define FLUSH_INTERVAL_NS 10000000
+
+typedef struct
+{
+    TraceRecord records[TRACE_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_bool in_use;
+    atomic_ullong dropped;
+} TraceRing;
+
+static TraceRing rings[MAX_TRACE_RINGS];
+
+static _Thread_local TraceRing *thread_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static FILE *trace_file;
+static atomic_bool trace_enabled;
+static atomic_bool flusher_running;
+static pthread_t flusher_thread;
+
+/**
+ * Returns the time in nanoseconds from an arbitrary fixed point.
+ **/
+static U64 trace_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (U64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Gives the ring of an exiting thread back so a later thread can reuse it.
+ * Events still in the ring are drained by the flusher as usual.
+ **/
+static void release_ring(void *ring)
+{
+    atomic_store(&((TraceRing *) ring)->in_use, false);
+}
+
+static void create_ring_key(void)
+{
+    pthread_key_create(&ring_key, release_ring);
+}
+
+/**
+ * Claims an unused ring for the calling thread. Returns NULL if every ring is
+ * taken.
+ **/
+static TraceRing* acquire_ring(void)
+{
+    pthread_once(&ring_key_once, create_ring_key);
+
+    for (int i = 0; i < MAX_TRACE_RINGS; i++)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&rings[i].in_use, &expected, true))
+        {
+            thread_ring = &rings[i];
+            pthread_setspecific(ring_key, thread_ring);
+            return thread_ring;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Records an event of the calling thread if a trace file is open.
+ **/
+void trace_record(TraceType type, U32 arg)
+{
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+        return;
+
+    TraceRing *ring = (thread_ring != NULL) ? thread_ring : acquire_ring();
+    if (ring == NULL)
+        return;
+
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    // Drops the event instead of waiting for the flusher when the ring is full
+    if (head - tail == TRACE_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    ring->records[head % TRACE_RING_SIZE] = (TraceRecord) {
+        trace_time(), arg, type, ring - rings, 0
+    };
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Writes every event recorded so far to the trace file.
+ **/
+static void drain_rings(void)
+{
+    for (int i = 0; i < MAX_TRACE_RINGS; i++)
+    {
+        TraceRing *ring = &rings[i];
+
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (; tail != head; tail++)
+            fwrite(&ring->records[tail % TRACE_RING_SIZE], sizeof(TraceRecord), 1, trace_file);
+
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+}
+
+/**
+ * Entry point of the flusher thread, which periodically drains the rings.
+ **/
+static void* flusher_thread_main(void *arg)
+{
+    while (atomic_load(&flusher_running))
+    {
+        drain_rings();
+
+        struct timespec delay = {0, FLUSH_INTERVAL_NS};
+        nanosleep(&delay, NULL);
+    }
+
+    return NULL;
+}
+
+/**
+ * Starts recording events into the given trace file. Returns whether the file
+ * could be opened.
+ **/
+bool trace_open(char *filename)
+{
+    trace_close();
+
+    trace_file = fopen(filename, "wb");
+    if (trace_file == NULL)
+        return false;
+
+    fwrite(TRACE_MAGIC, 1, 8, trace_file);
+
+    // Discards events left over from a previous trace
+    for (int i = 0; i < MAX_TRACE_RINGS; i++)
+    {
+        atomic_store(&rings[i].tail, atomic_load(&rings[i].head));
+        atomic_store(&rings[i].dropped, 0);
+    }
+
+    atomic_store(&flusher_running, true);
+    if (pthread_create(&flusher_thread, NULL, flusher_thread_main, NULL) != 0)
+    {
+        atomic_store(&flusher_running, false);
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+
+    atomic_store(&trace_enabled, true);
+    return true;
+}
+
+/**
+ * Stops recording events, writes every buffered event and closes the trace file.
+ **/
+void trace_close(void)
+{
+    if (trace_file == NULL)
+        return;
+
+    atomic_store(&trace_enabled, false);
+    atomic_store(&flusher_running, false);
+    pthread_join(flusher_thread, NULL);
+    drain_rings();
+
+    U64 dropped = 0;
+    for (int i = 0; i < MAX_TRACE_RINGS; i++)
+        dropped += atomic_load(&rings[i].dropped);
+    if (dropped > 0)
+        fprintf(stderr, "Trace dropped %llu events.\n", (unsigned long long) dropped);
+
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+#endif
+
+/**
+ * Converts the binary trace file into a Chrome trace JSON file. Returns
+ * whether the conversion succeeded.
+ **/
+bool trace_convert(char *trace_filename, char *json_filename)
+{
+    static const char *STOP_REASONS[] = {"requested", "time", "nodes"};
+
+    FILE *trace = fopen(trace_filename, "rb");
+    if (trace == NULL)
+        return false;
+
+    char magic[8];
+    if (fread(magic, 1, 8, trace) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0)
+    {
+        fclose(trace);
+        return false;
+    }
+
+    FILE *json = fopen(json_filename, "w");
+    if (json == NULL)
+    {
+        fclose(trace);
+        return false;
+    }
+
+    // Finds the earliest event so timestamps start at zero
+    TraceRecord record;
+    U64 start_time = (U64) -1;
+    while (fread(&record, sizeof(TraceRecord), 1, trace) == 1)
+    {
+        if (record.time < start_time)
+            start_time = record.time;
+    }
+    fseek(trace, 8, SEEK_SET);
+
+    fprintf(json, "{\"traceEvents\": [\n");
+    for (int i = 0; fread(&record, sizeof(TraceRecord), 1, trace) == 1; i++)
+    {
+        fprintf(json, "%s{\"pid\": 1, \"tid\": %i, \"ts\": %.3f, ",
+            (i > 0) ? ",\n" : "", record.thread, (record.time - start_time) / 1000.0);
+
+        switch (record.type)
+        {
+            case TRACE_SEARCH_START:
+                fprintf(json, "\"ph\": \"B\", \"name\": \"search\", \"args\": {\"threads\": %u}}", record.arg);
+                break;
+            case TRACE_SEARCH_END:
+                fprintf(json, "\"ph\": \"E\", \"name\": \"search\"}");
+                break;
+            case TRACE_ITERATION_START:
+                fprintf(json, "\"ph\": \"B\", \"name\": \"depth %u\", \"args\": {\"depth\": %u}}", record.arg, record.arg);
+                break;
+            case TRACE_ITERATION_END:
+                fprintf(json, "\"ph\": \"E\", \"name\": \"depth %u\"}", record.arg);
+                break;
+            case TRACE_ASPIRATION_RESEARCH:
+                fprintf(json, "\"ph\": \"i\", \"s\": \"t\", \"name\": \"aspiration re-search\", \"args\": {\"depth\": %u}}", record.arg);
+                break;
+            case TRACE_TABLE_RESIZE:
+                fprintf(json, "\"ph\": \"i\", \"s\": \"g\", \"name\": \"table resize\", \"args\": {\"mb\": %u}}", record.arg);
+                break;
+            default:
+                fprintf(json, "\"ph\": \"i\", \"s\": \"g\", \"name\": \"stop\", \"args\": {\"reason\": \"%s\"}}",
+                    (record.arg <= STOP_NODES) ? STOP_REASONS[record.arg] : "unknown");
+                break;
+        }
+    }
+    fprintf(json, "\n]}\n");
+
+    fclose(trace);
+    fclose(json);
+
+    return true;
+}
@@ -1,118 +1,379 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "transposition_table.h"
+#include "chessboard.h"
+#include "huge_pages.h"
+#include "stats.h"
+
+#define MOVE_BITS 0xffff
+#define SCORE_SHIFT 16
+#define DEPTH_SHIFT 32
+#define BOUND_SHIFT 40
+#define AGE_SHIFT 42
+#define AGE_BITS 0x3f
+#define KEY_SHIFT 48
+
+// Upper bits of the key kept in an entry to tell apart the positions sharing a slot
+#define KeyCheck(key) ((key) >> KEY_SHIFT)
+
+#define FILE_MAGIC "CETTABLE"
+#define HEADER_SIZE 48
+
+typedef struct
+{
+    char magic[8];
+    U32 version;
+    U32 entry_size;
+    U64 key_scheme;
+    U64 size;
+    U8 age;
+    U8 unused[15];
+} FileHeader;
+
+/**
+ * Returns a fingerprint of the Zobrist keys, so tables saved by a build that
+ * generates other keys are rejected.
+ **/
+static U64 key_scheme(void)
+{
+    U64 fingerprint = 0xcbf29ce484222325;
+
+    for (int piece = 0; piece < 12; piece++)
+    {
+        for (int square = A1; square <= H8; square++)
+            fingerprint = (fingerprint ^ PIECE_KEYS[piece][square]) * 0x100000001b3;
+    }
+
+    for (int castle_permission = 0; castle_permission < 16; castle_permission++)
+        fingerprint = (fingerprint ^ CASTLE_KEYS[castle_permission]) * 0x100000001b3;
+
+    fingerprint = (fingerprint ^ SIDE_KEY[WHITE]) * 0x100000001b3;
+    fingerprint = (fingerprint ^ SIDE_KEY[BLACK]) * 0x100000001b3;
+
+    return fingerprint;
+}
+
+/**
+ * Fills the header of a file holding a table of the given size.
+ **/
+static void write_header(FileHeader *header, U64 size, U8 age)
+{
+    memset(header, 0, sizeof(FileHeader));
+    memcpy(header->magic, FILE_MAGIC, sizeof(header->magic));
+    header->version = TABLE_FILE_VERSION;
+    header->entry_size = sizeof(Entry);
+    header->key_scheme = key_scheme();
+    header->size = size;
+    header->age = age;
+}
 
 /**
- * Returns a transposition table of the given size that was allocated on the heap. Null will be
- * returned if the table was not able to be allocated on the heap.
+ * Returns whether the header belongs to a file of the given size written with
+ * the current entry layout and keys.
  **/
-TranspositionTable* table_init(int size)
+static bool valid_header(FileHeader *header, U64 file_size)
 {
+    return file_size > HEADER_SIZE
+        && memcmp(header->magic, FILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == TABLE_FILE_VERSION
+        && header->entry_size == sizeof(Entry)
+        && header->key_scheme == key_scheme()
+        && (file_size - HEADER_SIZE) % sizeof(Entry) == 0
+        && header->size == (file_size - HEADER_SIZE) / sizeof(Entry);
+}
+
+/**
+ * Returns a transposition table of the given size whose entries are allocated
+ * on huge pages. Null will be returned if the table was not able to be allocated.
+ **/
+TranspositionTable* table_init(U64 size)
+{
+    if (size == 0)
+        return NULL;
+
     TranspositionTable* table = malloc(sizeof(TranspositionTable));
 
     if (table == NULL)
         return NULL;
 
-    table->entries = calloc(size, sizeof(Entry));
-    table->num_entries = 0;
+    table->entries = huge_pages_alloc(size * sizeof(Entry));
     table->size = size;
+    table->age = 0;
+    table->file = NULL;
+    table->file_device = 0;
+    table->file_inode = 0;
 
     if (table->entries == NULL)
+    {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+/**
+ * Memory maps the table stored in the given file so every change is written
+ * through to it, creating a table of the given size if the file does not
+ * exist. Null will be returned if the file could not be mapped or was written
+ * with another entry layout or other keys.
+ **/
+TranspositionTable* table_map(char *filename, U64 size)
+{
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return NULL;
+
+    struct stat file_stat;
+    bool created = fstat(fd, &file_stat) == 0 && file_stat.st_size == 0;
+    U64 file_size = created ? HEADER_SIZE + size * sizeof(Entry) : (U64) file_stat.st_size;
+
+    // New files are extended with zeros, which are empty entries
+    if (created && (size == 0 || ftruncate(fd, file_size) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    U8 *file = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (file == MAP_FAILED)
+        return NULL;
+
+    FileHeader *header = (FileHeader*) file;
+    if (created)
+        write_header(header, size, 0);
+
+    TranspositionTable* table = valid_header(header, file_size) ? malloc(sizeof(TranspositionTable)) : NULL;
+    if (table == NULL)
+    {
+        munmap(file, file_size);
+        return NULL;
+    }
+
+    table->entries = (Entry*) (file + HEADER_SIZE);
+    table->size = header->size;
+    table->age = header->age;
+    table->file = file;
+    table->file_device = file_stat.st_dev;
+    table->file_inode = file_stat.st_ino;
+
+    return table;
+}
+
+/**
+ * Returns a transposition table allocated on the heap with the entries of the
+ * table saved in the given file. Null will be returned if the file could not
+ * be read or was written with another entry layout or other keys.
+ **/
+TranspositionTable* table_load(char *filename)
+{
+    FILE *file_ptr = fopen(filename, "rb");
+    if (file_ptr == NULL)
         return NULL;
 
+    struct stat file_stat;
+    FileHeader header;
+    TranspositionTable* table = NULL;
+
+    if (fstat(fileno(file_ptr), &file_stat) == 0
+        && fread(&header, sizeof(FileHeader), 1, file_ptr) == 1
+        && valid_header(&header, file_stat.st_size)
+        && (table = table_init(header.size)) != NULL)
+    {
+        if (fread(table->entries, sizeof(Entry), table->size, file_ptr) == table->size)
+        {
+            table->age = header.age;
+        }
+        else
+        {
+            table_free(table);
+            table = NULL;
+        }
+    }
+
+    fclose(file_ptr);
     return table;
 }
 
 /**
- * Frees the memory the transposition table was taking up.
+ * Saves the entries of the transposition table to the given file. Returns
+ * whether the file was written. A mapped table is flushed to its own file,
+ * which is never rewritten while it is mapped.
+ **/
+bool table_save(TranspositionTable* table, char *filename)
+{
+    if (table->file != NULL)
+    {
+        ((FileHeader*) table->file)->age = table->age;
+        bool synced = msync(table->file, HEADER_SIZE + table->size * sizeof(Entry), MS_SYNC) == 0;
+
+        // Truncating the mapped file would take the entries away from under the mapping
+        struct stat file_stat;
+        if (stat(filename, &file_stat) == 0
+            && (U64) file_stat.st_dev == table->file_device && (U64) file_stat.st_ino == table->file_inode)
+            return synced;
+    }
+
+    FILE *file_ptr = fopen(filename, "wb");
+    if (file_ptr == NULL)
+        return false;
+
+    FileHeader header;
+    write_header(&header, table->size, table->age);
+
+    bool success = fwrite(&header, sizeof(FileHeader), 1, file_ptr) == 1
+        && fwrite(table->entries, sizeof(Entry), table->size, file_ptr) == table->size;
+
+    return fclose(file_ptr) == 0 && success;
+}
+
+/**
+ * Frees the memory the transposition table was taking up, unmapping it if it
+ * was mapped from a file.
  **/
 void table_free(TranspositionTable* table)
 {
     if (table == NULL)
         return;
-    
-    free(table->entries);
+
+    if (table->file != NULL)
+    {
+        // Keeps the age so the next search still prefers its own entries
+        ((FileHeader*) table->file)->age = table->age;
+        munmap(table->file, HEADER_SIZE + table->size * sizeof(Entry));
+    }
+    else
+    {
+        huge_pages_free(table->entries, table->size * sizeof(Entry));
+    }
+
     free(table);
 }
 
 /**
- * Inserts an entry into the transposition table. Returns whether it was able
- * to insert the element.
+ * Removes every entry from the transposition table, splitting the work over
+ * num_threads threads.
  **/
-bool table_insert(TranspositionTable* table, U64 key, Move move)
+void table_clear(TranspositionTable* table, int num_threads)
 {
-    if (table->num_entries == table->size)
-        return false;
+    huge_pages_clear(table->entries, table->size * sizeof(Entry), num_threads);
+    table->age = 0;
+}
 
-    // Probs the table to find an empty slot
-    int index = key % table->size;
-    while (table->entries[index].occupied == true)
-    {
-        index ++;
+/**
+ * Marks the start of a new search so entries from previous searches are
+ * replaced before entries from the current one.
+ **/
+void table_new_search(TranspositionTable* table)
+{
+    table->age++;
+}
+
+/**
+ * Stores the result of searching the position with the given key. The entry
+ * already in the slot is only replaced if it is less valuable.
+ **/
+void table_store(TranspositionTable* table, U64 key, Move move, int score, int depth, Bound bound)
+{
+    StatsBegin(TABLE_STORE);
+
+    Entry *entry = &table->entries[key % table->size];
+
+    // Copies the entry once since other threads may be writing to it
+    U64 old_data = entry->data;
+    bool same_key = KeyCheck(old_data) == KeyCheck(key);
 
-        // Wraps around to the beginning of the table
-        if (index >= table->size)
-            index = 0;
+    int old_depth = (old_data >> DEPTH_SHIFT) & 0xff;
+    int old_age = (old_data >> AGE_SHIFT) & AGE_BITS;
+
+    // Keeps deeper results of the current search unless the new result is exact
+    if ((!same_key && old_age == (table->age & AGE_BITS) && old_depth > depth && bound != BOUND_EXACT)
+        || (same_key && old_depth > depth + 2 && bound != BOUND_EXACT))
+    {
+        StatsEnd(TABLE_STORE);
+        return;
     }
 
-    table->entries[index].occupied = true;
-    table->entries[index].deleted = false;
-    table->entries[index].key = key;
-    table->entries[index].move = move;
-    table->num_entries++;
+    // Keeps the previous best move when the new result does not have one
+    U64 packed_move = (IsNullMove(move) && same_key)
+        ? (old_data & MOVE_BITS)
+        : move;
 
-    return true;
+    U64 data = packed_move
+        | (U64) (U16) score << SCORE_SHIFT
+        | (U64) (depth & 0xff) << DEPTH_SHIFT
+        | (U64) bound << BOUND_SHIFT
+        | (U64) (table->age & AGE_BITS) << AGE_SHIFT
+        | KeyCheck(key) << KEY_SHIFT;
+
+    entry->data = data;
+
+    StatsEnd(TABLE_STORE);
 }
 
 /**
- * Deletes the entry with the given key from the transposition table. Returns 
- * whether it was able to delete the element.
+ * Starts loading the slot of the given key into the cache, so a probe issued
+ * shortly after does not wait on memory.
  **/
-bool table_delete(TranspositionTable* table, U64 key)
+void table_prefetch(TranspositionTable* table, U64 key)
 {
-    // Probs the table until an empty slot is found or a slot with the given key
-    int index = key % table->size;
-    while (table->entries[index].occupied == true || table->entries[index].deleted == true)
-    {   
-        if (table->entries[index].key == key)
-            break;
-
-        index ++;
-
-        // Wraps around to the beginning of the table
-        if (index >= table->size)
-            index = 0;
-    }
+    __builtin_prefetch(&table->entries[key % table->size]);
+}
+
+/**
+ * Looks up the position with the given key in the transposition table. Returns
+ * whether the key was found, in which case data is filled with its entry.
+ **/
+bool table_probe(TranspositionTable* table, U64 key, EntryData *data)
+{
+    StatsBegin(TABLE_PROBE);
+
+    Entry *entry = &table->entries[key % table->size];
+
+    // Copies the entry once since other threads may be writing to it
+    U64 entry_data = entry->data;
 
-    if (table->entries[index].key != key)
+    if (KeyCheck(entry_data) != KeyCheck(key) || entry_data == 0)
+    {
+        StatsIncrement(table_misses);
+        StatsEnd(TABLE_PROBE);
         return false;
-    
-    table->entries[index].deleted = true;
-    table->entries[index].occupied = false;
-    table->num_entries--;
+    }
+
+    data->move = entry_data & MOVE_BITS;
+    data->score = (int16_t) (entry_data >> SCORE_SHIFT);
+    data->depth = (entry_data >> DEPTH_SHIFT) & 0xff;
+    data->bound = (entry_data >> BOUND_SHIFT) & 0x3;
+
+    StatsIncrement(table_hits);
+    StatsEnd(TABLE_PROBE);
     return true;
 }
 
 /**
- * Returns the move corresponding to the given key in the transposition table.
+ * Returns how full the transposition table is with entries from the current
+ * search in permill, estimated from the first thousand slots.
  **/
-Move* table_lookup(TranspositionTable* table, U64 key)
+int table_hashfull(TranspositionTable* table)
 {
-    // Probs the table until an empty slot is found or a slot with the given key
-    int index = key % table->size;
-    while (table->entries[index].occupied == true || table->entries[index].deleted == true)
-    {   
-        if (table->entries[index].key == key)
-            break;
-
-        index ++;
-
-        // Wraps around to the beginning of the table
-        if (index >= table->size)
-            index = 0;
+    U64 sample_size = (table->size < 1000) ? table->size : 1000;
+
+    int count = 0;
+    for (U64 i = 0; i < sample_size; i++)
+    {
+        U64 data = table->entries[i].data;
+
+        if (data != 0 && ((data >> AGE_SHIFT) & AGE_BITS) == (table->age & AGE_BITS))
+            count++;
     }
 
-    return (table->entries[index].key == key && table->entries[index].deleted == false) 
-        ? &(table->entries[index].move) 
-        : NULL;
+    return count * 1000 / sample_size;
 }
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "tuner.h"
+#include "evaluation.h"
+#include "selfplay.h"
+#include "search.h"
+
+#define MAX_TUNER_THREADS 256
+#define REPORT_INTERVAL 100
+
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define ADAM_EPSILON 1e-8
+
+typedef struct
+{
+    int8_t coefficients[NUM_EVAL_TERMS];
+
+    // Game result from white's point of view in half points: 0, 1 or 2
+    U8 result;
+} TunerEntry;
+
+typedef struct
+{
+    TunerEntry *entries;
+    SelfplayRecord *records;
+    U64 start;
+    U64 end;
+
+    double *weights;
+    double scale;
+
+    double gradient[NUM_EVAL_TERMS];
+    double error;
+} TunerThread;
+
+/**
+ * Returns the evaluation of the board from the side to move's point of view
+ * after resolving captures, and fills coefficients with the terms of the quiet
+ * position the score comes from.
+ **/
+static int quiescence(ChessBoard *board, int alpha, int beta, int depth, int coefficients[NUM_EVAL_TERMS])
+{
+    evaluation_terms(board, coefficients);
+
+    int stand_pat = 0;
+    for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        stand_pat += coefficients[term] * EVAL_WEIGHTS[term];
+    if (board->current_color == BLACK)
+        stand_pat = -stand_pat;
+
+    if (stand_pat >= beta || depth == 0)
+        return stand_pat;
+    if (stand_pat > alpha)
+        alpha = stand_pat;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    // Orders the captures by the value of the captured piece
+    int values[256];
+    for (int i = 0; i < list.size; i++)
+    {
+        Piece captured = chessboard_captured_piece(board, list.moves[i]);
+        int term = (captured - WHITE_PAWNS) % 6;
+
+        values[i] = (captured == EMPTY) ? -1 : (term <= TERM_QUEEN) ? EVAL_WEIGHTS[term] : 0;
+    }
+
+    for (int i = 0; i < list.size; i++)
+    {
+        int best = i;
+        for (int j = i + 1; j < list.size; j++)
+            best = (values[j] > values[best]) ? j : best;
+
+        if (values[best] < 0)
+            break;
+
+        Move move = list.moves[best];
+        list.moves[best] = list.moves[i];
+        values[best] = values[i];
+
+        if (!chessboard_make_move(board, move))
+            continue;
+
+        int child_coefficients[NUM_EVAL_TERMS];
+        int score = -quiescence(board, -beta, -alpha, depth - 1, child_coefficients);
+        chessboard_undo_move(board);
+
+        if (score > alpha)
+        {
+            alpha = score;
+            memcpy(coefficients, child_coefficients, sizeof(child_coefficients));
+
+            if (score >= beta)
+                break;
+        }
+    }
+
+    return alpha;
+}
+
+/**
+ * Entry point of the threads resolving their records into entries.
+ **/
+static void* resolve_main(void *arg)
+{
+    TunerThread *thread = arg;
+    ChessBoard *board = malloc(sizeof(ChessBoard));
+    if (board == NULL)
+        return NULL;
+
+    for (U64 i = thread->start; i < thread->end; i++)
+    {
+        SelfplayRecord *record = &thread->records[i];
+        int coefficients[NUM_EVAL_TERMS];
+
+        packed_decode(&record->position, board);
+        quiescence(board, -INFINITE_SCORE, INFINITE_SCORE, TUNER_QUIESCENCE_DEPTH, coefficients);
+
+        for (int term = 0; term < NUM_EVAL_TERMS; term++)
+            thread->entries[i].coefficients[term] = coefficients[term];
+        thread->entries[i].result = record->result + 1;
+    }
+
+    free(board);
+
+    return NULL;
+}
+
+/**
+ * Entry point of the threads accumulating the error and its gradient over
+ * their entries.
+ **/
+static void* gradient_main(void *arg)
+{
+    TunerThread *thread = arg;
+
+    memset(thread->gradient, 0, sizeof(thread->gradient));
+    thread->error = 0;
+
+    for (U64 i = thread->start; i < thread->end; i++)
+    {
+        TunerEntry *entry = &thread->entries[i];
+
+        double score = 0;
+        for (int term = 0; term < NUM_EVAL_TERMS; term++)
+            score += entry->coefficients[term] * thread->weights[term];
+
+        double prediction = 1 / (1 + exp(-thread->scale * score));
+        double difference = prediction - entry->result / 2.0;
+
+        thread->error += difference * difference;
+
+        double factor = difference * prediction * (1 - prediction);
+        for (int term = 0; term < NUM_EVAL_TERMS; term++)
+            thread->gradient[term] += factor * entry->coefficients[term];
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs the entry point on every thread and waits for them to finish.
+ **/
+static void run_threads(TunerThread *threads, int num_threads, void *(*entry_point)(void *))
+{
+    pthread_t handles[MAX_TUNER_THREADS];
+
+    for (int i = 0; i < num_threads; i++)
+        pthread_create(&handles[i], NULL, entry_point, &threads[i]);
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(handles[i], NULL);
+}
+
+/**
+ * Returns the mean squared error of the given weights and fills the gradient
+ * with its derivative for every weight.
+ **/
+static double compute_error(TunerThread *threads, int num_threads, U64 num_entries, double scale,
+    double *weights, double gradient[NUM_EVAL_TERMS])
+{
+    for (int i = 0; i < num_threads; i++)
+    {
+        threads[i].weights = weights;
+        threads[i].scale = scale;
+    }
+
+    run_threads(threads, num_threads, gradient_main);
+
+    double error = 0;
+    memset(gradient, 0, NUM_EVAL_TERMS * sizeof(double));
+    for (int i = 0; i < num_threads; i++)
+    {
+        error += threads[i].error;
+        for (int term = 0; term < NUM_EVAL_TERMS; term++)
+            gradient[term] += threads[i].gradient[term];
+    }
+
+    for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        gradient[term] *= 2 * scale / num_entries;
+
+    return error / num_entries;
+}
+
+/**
+ * Returns the sigmoid scale that best fits the given weights to the results,
+ * found with a golden section search.
+ **/
+static double fit_scale(TunerThread *threads, int num_threads, U64 num_entries, double *weights)
+{
+    double gradient[NUM_EVAL_TERMS];
+    double low = 0.0001, high = 1.0, ratio = (sqrt(5) - 1) / 2;
+
+    for (int i = 0; i < 50; i++)
+    {
+        double a = high - ratio * (high - low), b = low + ratio * (high - low);
+
+        if (compute_error(threads, num_threads, num_entries, a, weights, gradient)
+            < compute_error(threads, num_threads, num_entries, b, weights, gradient))
+            high = b;
+        else
+            low = a;
+    }
+
+    return (low + high) / 2;
+}
+
+/**
+ * Reads every record of the self-play container. Returns NULL if the container
+ * could not be read.
+ **/
+static SelfplayRecord* load_records(char *filename, U64 *num_records)
+{
+    *num_records = 0;
+
+    PackedReader *reader = packed_reader_open(filename);
+    if (reader == NULL)
+        return NULL;
+
+    SelfplayRecord *records = NULL;
+    if (reader->record_size == sizeof(SelfplayRecord))
+        records = malloc((reader->num_records + 1) * sizeof(SelfplayRecord));
+
+    while (records != NULL && packed_reader_next(reader, &records[*num_records]))
+        (*num_records)++;
+
+    packed_reader_close(reader);
+
+    return records;
+}
+
+/**
+ * Tunes the evaluation weights on the records of a self-play container and
+ * prints the tuned weights. Returns false if the container could not be read.
+ **/
+bool tuner_run(char *filename, TunerOptions *options)
+{
+    int num_threads = options->num_threads;
+    num_threads = (num_threads < 1) ? 1 : (num_threads > MAX_TUNER_THREADS) ? MAX_TUNER_THREADS : num_threads;
+
+    U64 num_entries;
+    SelfplayRecord *records = load_records(filename, &num_entries);
+    TunerEntry *entries = malloc((num_entries + 1) * sizeof(TunerEntry));
+    TunerThread *threads = calloc(num_threads, sizeof(TunerThread));
+    if (records == NULL || entries == NULL || threads == NULL || num_entries == 0)
+    {
+        free(records);
+        free(entries);
+        free(threads);
+        return false;
+    }
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        threads[i].entries = entries;
+        threads[i].records = records;
+        threads[i].start = num_entries * i / num_threads;
+        threads[i].end = num_entries * (i + 1) / num_threads;
+    }
+
+    long start_time = search_time();
+
+    run_threads(threads, num_threads, resolve_main);
+    free(records);
+
+    double weights[NUM_EVAL_TERMS], gradient[NUM_EVAL_TERMS];
+    double moment[NUM_EVAL_TERMS] = {0}, velocity[NUM_EVAL_TERMS] = {0};
+    for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        weights[term] = EVAL_WEIGHTS[term];
+
+    double scale = fit_scale(threads, num_threads, num_entries, weights);
+    printf("Loaded %llu positions in %li ms, sigmoid scale %.5f\n",
+        (unsigned long long) num_entries, search_time() - start_time, scale);
+
+    for (int epoch = 1; epoch <= options->epochs; epoch++)
+    {
+        double error = compute_error(threads, num_threads, num_entries, scale, weights, gradient);
+
+        for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        {
+            moment[term] = ADAM_BETA1 * moment[term] + (1 - ADAM_BETA1) * gradient[term];
+            velocity[term] = ADAM_BETA2 * velocity[term] + (1 - ADAM_BETA2) * gradient[term] * gradient[term];
+
+            double corrected_moment = moment[term] / (1 - pow(ADAM_BETA1, epoch));
+            double corrected_velocity = velocity[term] / (1 - pow(ADAM_BETA2, epoch));
+            weights[term] -= options->learning_rate * corrected_moment / (sqrt(corrected_velocity) + ADAM_EPSILON);
+        }
+
+        if (epoch == 1 || epoch % REPORT_INTERVAL == 0 || epoch == options->epochs)
+            printf("Epoch %i: error %.6f\n", epoch, error);
+    }
+
+    long time = search_time() - start_time;
+    printf("Tuned in %li ms, %.1f positions/second per epoch\n",
+        time, (double) num_entries * options->epochs * 1000 / (time > 0 ? time : 1));
+
+    printf("int EVAL_WEIGHTS[NUM_EVAL_TERMS] = {\n");
+    for (int term = 0; term < NUM_EVAL_TERMS; term++)
+        printf("    %li, // %s\n", lround(weights[term]), EVAL_TERM_NAMES[term]);
+    printf("};\n");
+
+    free(entries);
+    free(threads);
+
+    return true;
+}
@@ -0,0 +1,548 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "uci.h"
+#include "search.h"
+#include "bench.h"
+#include "book.h"
+#include "fen.h"
+#include "stats.h"
+#include "tablebase.h"
+#include "trace.h"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+#define DEFAULT_HASH 16
+#define MAX_HASH 65536
+#define MAX_THREADS 256
+#define EVAL_CACHE_SIZE (1 << 18)
+
+typedef struct
+{
+    ChessBoard board;
+    SearchInfo info;
+    PrincipalVariation pv;
+
+    pthread_t search_thread;
+    bool searching;
+
+    char hash_file[1000];
+
+    Book *book;
+    bool own_book;
+    bool book_best_move;
+    U64 random_state;
+} UciState;
+
+static UciState uci;
+
+/**
+ * Writes the move in long algebraic notation (e.g. e2e4, e7e8q) into the
+ * given buffer, which must hold at least 6 characters.
+ **/
+void uci_move_to_string(Move move, char *buffer)
+{
+    static const char PROMOTION_PIECE[] = {0, 0, 0, 0, 'r', 'n', 'b', 'q'};
+
+    if (IsNullMove(move))
+    {
+        strcpy(buffer, "0000");
+        return;
+    }
+
+    buffer[0] = 'a' + MoveOrigin(move) % 8;
+    buffer[1] = '1' + MoveOrigin(move) / 8;
+    buffer[2] = 'a' + MoveTarget(move) % 8;
+    buffer[3] = '1' + MoveTarget(move) / 8;
+    buffer[4] = PROMOTION_PIECE[MoveType(move)];
+    buffer[5] = '\0';
+}
+
+/**
+ * Returns the legal move on the board matching the given long algebraic
+ * notation. NULL_MOVE is returned if no such move exists.
+ **/
+Move uci_parse_move(ChessBoard *board, char *move_str)
+{
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    for (int i = 0; i < list.size; i++)
+    {
+        char buffer[6];
+        uci_move_to_string(list.moves[i], buffer);
+
+        if (strcmp(buffer, move_str) != 0)
+            continue;
+
+        // Only returns the move if it doesn't leave the king in check
+        if (chessboard_make_move(board, list.moves[i]))
+        {
+            chessboard_undo_move(board);
+            return list.moves[i];
+        }
+    }
+
+    return NULL_MOVE;
+}
+
+/**
+ * Prints an info line describing a completed search iteration.
+ **/
+static void report_iteration(SearchInfo *info, int depth, int line, int score, PrincipalVariation *pv)
+{
+    long time = search_time() - atomic_load(&info->start_time);
+    U64 nodes = atomic_load(&info->nodes);
+
+    printf("info depth %i ", depth);
+    if (info->multi_pv > 1)
+        printf("multipv %i ", line + 1);
+
+    printf("score ");
+    if (IsMateScore(score))
+        printf("mate %i ", search_mate_moves(score));
+    else
+        printf("cp %i ", search_centipawns(score));
+
+    printf("nodes %llu nps %llu hashfull %i time %li pv",
+        (unsigned long long) nodes,
+        (unsigned long long) (nodes * 1000 / (time > 0 ? time : 1)),
+        table_hashfull(info->table),
+        time);
+
+    for (int i = 0; i < pv->size; i++)
+    {
+        char buffer[6];
+        uci_move_to_string(pv->moves[i], buffer);
+        printf(" %s", buffer);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    if (line == 0)
+        uci.pv = *pv;
+}
+
+/**
+ * Entry point of the search thread. Searches the current position and prints
+ * the best move once the search is over.
+ **/
+static void* search_thread_main(void *arg)
+{
+    Move best_move = search_position(&uci.info, &uci.board);
+
+    char buffer[6];
+    uci_move_to_string(best_move, buffer);
+    printf("bestmove %s", buffer);
+
+    if (uci.pv.size >= 2 && SameMove(uci.pv.moves[0], best_move))
+    {
+        uci_move_to_string(uci.pv.moves[1], buffer);
+        printf(" ponder %s", buffer);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    StatsDump();
+
+    return NULL;
+}
+
+/**
+ * Stops the running search, if any, and waits for the search thread to exit.
+ **/
+static void stop_search(void)
+{
+    if (!uci.searching)
+        return;
+
+    TraceEvent(TRACE_STOP, STOP_REQUESTED);
+    atomic_store(&uci.info.stop, true);
+    pthread_join(uci.search_thread, NULL);
+    uci.searching = false;
+}
+
+/**
+ * Returns the next space separated token of the command.
+ **/
+static char* next_token(char **save)
+{
+    return strtok_r(NULL, " \t\n", save);
+}
+
+/**
+ * Handles: position [fen <fenstring> | startpos] moves <move1> ... <movei>
+ **/
+static void handle_position(char *args)
+{
+    char *moves = strstr(args, "moves");
+    if (moves != NULL)
+        *moves++ = '\0';
+
+    if (strncmp(args, "startpos", 8) == 0)
+    {
+        chessboard_init(&uci.board, START_FEN);
+    }
+    else if (strncmp(args, "fen ", 4) == 0)
+    {
+        FenError error = fen_parse(&uci.board, args + 4, NULL);
+        if (error != FEN_OK)
+        {
+            printf("info string invalid fen: %s\n", fen_error_string(error));
+            chessboard_init(&uci.board, START_FEN);
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    if (moves == NULL)
+        return;
+
+    char *save;
+    strtok_r(moves, " \t\n", &save);
+    for (char *token = next_token(&save); token != NULL; token = next_token(&save))
+    {
+        Move move = uci_parse_move(&uci.board, token);
+        if (IsNullMove(move))
+        {
+            printf("info string illegal move %s\n", token);
+            break;
+        }
+
+        chessboard_make_move(&uci.board, move);
+    }
+}
+
+/**
+ * Returns the book move of the current position, chosen with the configured
+ * selection, or NULL_MOVE if the book is disabled or has no move.
+ **/
+static Move probe_book(void)
+{
+    if (!uci.own_book || uci.book == NULL)
+        return NULL_MOVE;
+
+    // Steps a xorshift64 generator, which only needs to differ between games
+    uci.random_state ^= uci.random_state << 13;
+    uci.random_state ^= uci.random_state >> 7;
+    uci.random_state ^= uci.random_state << 17;
+
+    return book_move(uci.book, &uci.board, uci.book_best_move ? BOOK_BEST : BOOK_WEIGHTED, uci.random_state);
+}
+
+/**
+ * Handles: go [ponder] [wtime x] [btime x] [winc x] [binc x] [movestogo x]
+ *             [depth x] [nodes x] [movetime x] [infinite]
+ **/
+static void handle_go(char *args)
+{
+    SearchLimits limits = {0};
+    bool ponder = false;
+
+    char *save, *token = strtok_r(args, " \t\n", &save);
+    for (; token != NULL; token = next_token(&save))
+    {
+        char *value;
+
+        if (strcmp(token, "infinite") == 0)
+            limits.infinite = true;
+        else if (strcmp(token, "ponder") == 0)
+            ponder = true;
+        else if ((value = next_token(&save)) == NULL)
+            break;
+        else if (strcmp(token, "wtime") == 0)
+            limits.time[WHITE] = atol(value);
+        else if (strcmp(token, "btime") == 0)
+            limits.time[BLACK] = atol(value);
+        else if (strcmp(token, "winc") == 0)
+            limits.increment[WHITE] = atol(value);
+        else if (strcmp(token, "binc") == 0)
+            limits.increment[BLACK] = atol(value);
+        else if (strcmp(token, "movestogo") == 0)
+            limits.moves_to_go = atoi(value);
+        else if (strcmp(token, "depth") == 0)
+            limits.depth = atoi(value);
+        else if (strcmp(token, "nodes") == 0)
+            limits.nodes = strtoull(value, NULL, 10);
+        else if (strcmp(token, "movetime") == 0)
+            limits.move_time = atol(value);
+    }
+
+    // Plays book moves without searching unless asked to think about the position
+    Move book_move = (ponder || limits.infinite) ? NULL_MOVE : probe_book();
+    if (!IsNullMove(book_move))
+    {
+        char buffer[6];
+        uci_move_to_string(book_move, buffer);
+        printf("bestmove %s\n", buffer);
+        return;
+    }
+
+    uci.info.limits = limits;
+    uci.pv.size = 0;
+    atomic_store(&uci.info.stop, false);
+    atomic_store(&uci.info.pondering, ponder);
+
+    if (pthread_create(&uci.search_thread, NULL, search_thread_main, NULL) == 0)
+        uci.searching = true;
+}
+
+/**
+ * Replaces the transposition table with the given one unless it is null.
+ **/
+static void replace_table(TranspositionTable *table, char *action)
+{
+    if (table == NULL)
+    {
+        printf("info string could not %s hash file %s\n", action, uci.hash_file);
+        return;
+    }
+
+    table_free(uci.info.table);
+    uci.info.table = table;
+
+    TraceEvent(TRACE_TABLE_RESIZE, table->size * sizeof(Entry) / (1024 * 1024));
+}
+
+/**
+ * Handles: setoption name <id> [value <x>]
+ **/
+static void handle_setoption(char *args)
+{
+    char *name = strstr(args, "name ");
+    char *value = strstr(args, " value ");
+    if (name == NULL)
+        return;
+
+    // Buttons have no value
+    name += 5;
+    if (value != NULL)
+    {
+        *value = '\0';
+        value += 7;
+    }
+    else
+    {
+        value = name + strlen(name);
+    }
+
+    if (strcasecmp(name, "Hash") == 0)
+    {
+        int hash_size = atoi(value);
+        if (hash_size < 1 || hash_size > MAX_HASH)
+            return;
+
+        TranspositionTable *table = table_init((U64) hash_size * 1024 * 1024 / sizeof(Entry));
+        if (table == NULL)
+        {
+            printf("info string could not allocate %i MB hash\n", hash_size);
+            return;
+        }
+
+        // Faults in and zeroes every page on as many threads as will search, before the first search
+        table_clear(table, uci.info.num_threads);
+
+        table_free(uci.info.table);
+        uci.info.table = table;
+
+        TraceEvent(TRACE_TABLE_RESIZE, hash_size);
+    }
+    else if (strcasecmp(name, "HashFile") == 0)
+    {
+        snprintf(uci.hash_file, sizeof(uci.hash_file), "%s", (strcmp(value, "<empty>") == 0) ? "" : value);
+    }
+    else if (strcasecmp(name, "ClearHash") == 0)
+    {
+        table_clear(uci.info.table, uci.info.num_threads);
+    }
+    else if (strcasecmp(name, "SaveHash") == 0)
+    {
+        if (!table_save(uci.info.table, uci.hash_file))
+            printf("info string could not save hash file %s\n", uci.hash_file);
+    }
+    else if (strcasecmp(name, "LoadHash") == 0)
+    {
+        replace_table(table_load(uci.hash_file), "load");
+    }
+    else if (strcasecmp(name, "MapHash") == 0)
+    {
+        replace_table(table_map(uci.hash_file, uci.info.table->size), "map");
+    }
+    else if (strcasecmp(name, "Threads") == 0)
+    {
+        int num_threads = atoi(value);
+        if (1 <= num_threads && num_threads <= MAX_THREADS)
+            uci.info.num_threads = num_threads;
+    }
+    else if (strcasecmp(name, "MultiPV") == 0)
+    {
+        int multi_pv = atoi(value);
+        if (1 <= multi_pv && multi_pv <= MAX_MULTI_PV)
+            uci.info.multi_pv = multi_pv;
+    }
+    else if (strcasecmp(name, "TablebasePath") == 0)
+    {
+        if (*value == '\0' || strcmp(value, "<empty>") == 0)
+            tablebase_free();
+        else
+            printf("info string mapped %i tablebases\n", tablebase_init(value));
+    }
+    else if (strcasecmp(name, "OwnBook") == 0)
+    {
+        uci.own_book = strcasecmp(value, "true") == 0;
+    }
+    else if (strcasecmp(name, "BookFile") == 0)
+    {
+        book_close(uci.book);
+        uci.book = NULL;
+
+        if (*value != '\0' && strcmp(value, "<empty>") != 0 && (uci.book = book_open(value)) == NULL)
+            printf("info string could not open book %s\n", value);
+    }
+    else if (strcasecmp(name, "BookBestMove") == 0)
+    {
+        uci.book_best_move = strcasecmp(value, "true") == 0;
+    }
+#ifdef ENABLE_TRACE
+    else if (strcasecmp(name, "TraceFile") == 0)
+    {
+        if (*value == '\0' || strcmp(value, "<empty>") == 0)
+            trace_close();
+        else if (!trace_open(value))
+            printf("info string could not open trace file %s\n", value);
+    }
+#endif
+}
+
+/**
+ * Reads UCI commands from stdin and answers them on stdout until the quit
+ * command is received. Searches run on a separate thread so commands such as
+ * stop and isready are answered while the engine is thinking.
+ **/
+void uci_loop(void)
+{
+    memset(&uci, 0, sizeof(UciState));
+    uci.info.num_threads = 1;
+    uci.info.multi_pv = 1;
+    uci.info.report = report_iteration;
+    uci.info.table = table_init((U64) DEFAULT_HASH * 1024 * 1024 / sizeof(Entry));
+    uci.info.eval_cache = eval_cache_init(EVAL_CACHE_SIZE);
+    uci.random_state = search_time() | 1;
+    chessboard_init(&uci.board, START_FEN);
+
+    if (uci.info.table == NULL)
+    {
+        printf("info string could not allocate hash\n");
+        return;
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, stdin) != -1)
+    {
+        // Splits the line into the command and its arguments
+        line[strcspn(line, "\r\n")] = '\0';
+        char *args = line + strcspn(line, " \t");
+        if (*args != '\0')
+            *args++ = '\0';
+
+        if (strcmp(line, "uci") == 0)
+        {
+            printf("id name Chess Engine\n");
+            printf("id author Alexander Azizi-Martin\n");
+            printf("option name Hash type spin default %i min 1 max %i\n", DEFAULT_HASH, MAX_HASH);
+            printf("option name HashFile type string default <empty>\n");
+            printf("option name ClearHash type button\n");
+            printf("option name SaveHash type button\n");
+            printf("option name LoadHash type button\n");
+            printf("option name MapHash type button\n");
+            printf("option name Threads type spin default 1 min 1 max %i\n", MAX_THREADS);
+            printf("option name MultiPV type spin default 1 min 1 max %i\n", MAX_MULTI_PV);
+            printf("option name Ponder type check default false\n");
+            printf("option name TablebasePath type string default <empty>\n");
+            printf("option name OwnBook type check default false\n");
+            printf("option name BookFile type string default <empty>\n");
+            printf("option name BookBestMove type check default false\n");
+#ifdef ENABLE_TRACE
+            printf("option name TraceFile type string default <empty>\n");
+#endif
+            printf("uciok\n");
+        }
+        else if (strcmp(line, "isready") == 0)
+        {
+            printf("readyok\n");
+        }
+        else if (strcmp(line, "ucinewgame") == 0)
+        {
+            stop_search();
+
+            // A mapped table is kept warm across games and runs, and only emptied by ClearHash
+            if (uci.info.table->file == NULL)
+                table_clear(uci.info.table, uci.info.num_threads);
+            if (uci.info.eval_cache != NULL)
+                eval_cache_clear(uci.info.eval_cache);
+        }
+        else if (strcmp(line, "position") == 0)
+        {
+            stop_search();
+            handle_position(args);
+        }
+        else if (strcmp(line, "go") == 0)
+        {
+            stop_search();
+            handle_go(args);
+        }
+        else if (strcmp(line, "stop") == 0)
+        {
+            stop_search();
+        }
+        else if (strcmp(line, "ponderhit") == 0)
+        {
+            search_ponderhit(&uci.info);
+        }
+        else if (strcmp(line, "setoption") == 0)
+        {
+            stop_search();
+            handle_setoption(args);
+        }
+        else if (strcmp(line, "bench") == 0)
+        {
+            stop_search();
+            bench_run(bench_parse_depth(args, BENCH_DEPTH), strstr(args, "counters") != NULL);
+        }
+        else if (strcmp(line, "perft") == 0)
+        {
+            stop_search();
+            bench_perft(bench_parse_depth(args, PERFT_DEPTH), strstr(args, "counters") != NULL);
+        }
+        else if (strcmp(line, "d") == 0)
+        {
+            char fen[FEN_MAX_LENGTH];
+            fen_write(&uci.board, fen);
+
+            chessboard_print(&uci.board);
+            printf("Fen: %s\n", fen);
+        }
+        else if (strcmp(line, "quit") == 0)
+        {
+            break;
+        }
+
+        fflush(stdout);
+    }
+
+    stop_search();
+#ifdef ENABLE_TRACE
+    trace_close();
+#endif
+    free(line);
+    table_free(uci.info.table);
+    eval_cache_free(uci.info.eval_cache);
+    book_close(uci.book);
+    tablebase_free();
+}
@@ -0,0 +1,100 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "attack_fill.h"
+
+#define TESTING_DEPTH 2
+
+/**
+ * Initializes all the lookup tables used for move generation.
+ */
+void init_all(void);
+
+/**
+ * Asserts that the squares attacked by the side not to move match testing
+ * every square, in every position reached within the given depth.
+ */
+void assert_attacks(ChessBoard *board, int depth);
+
+/**
+ * Tests the setwise attacks of both sides against the attacks of single squares.
+ */
+Test(attack_fill, side_attacks, .init = init_all)
+{
+    FILE *file_ptr = fopen("tests/data/perftsuite.epd", "r");
+    cr_assert_not_null(file_ptr);
+
+    char line[1000];
+    while (fgets(line, sizeof(line), file_ptr) != NULL)
+    {
+        static ChessBoard board;
+        chessboard_init(&board, strtok(line, ";"));
+
+        assert_attacks(&board, TESTING_DEPTH);
+    }
+
+    fclose(file_ptr);
+}
+
+/**
+ * Tests the sliders against looking up the attacks of each piece.
+ */
+Test(attack_fill, slider_attacks, .init = init_all)
+{
+    U64 seed = 1;
+    for (int i = 0; i < 10000; i++)
+    {
+        BitBoard random[3];
+        for (int j = 0; j < 3; j++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            random[j] = seed;
+        }
+
+        // Sparse sliders on a board of about half occupied squares
+        BitBoard occupied = random[0];
+        BitBoard orthogonal = random[1] & random[2] & occupied;
+        BitBoard diagonal = random[1] & ~random[2] & (random[2] >> 3) & occupied;
+
+        BitBoard expected = 0, pieces;
+        for (pieces = orthogonal; pieces; pieces &= pieces - 1)
+            expected |= lookup_rook_attacks(bitboard_scan_forward(pieces), occupied);
+        for (pieces = diagonal; pieces; pieces &= pieces - 1)
+            expected |= lookup_bishop_attacks(bitboard_scan_forward(pieces), occupied);
+
+        cr_assert_eq(attack_fill_sliders(orthogonal, diagonal, occupied), expected);
+    }
+}
+
+void assert_attacks(ChessBoard *board, int depth)
+{
+    BitBoard attacks = attack_fill_side(board, board->current_color ^ 1, board->occupied_squares);
+    for (int square = 0; square < 64; square++)
+        cr_assert_eq((attacks >> square) & 1, chessboard_squared_attacked(board, square));
+
+    if (depth == 0)
+        return;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+    for (int i = 0; i < list.size; i++)
+    {
+        if (chessboard_make_move(board, list.moves[i]))
+        {
+            assert_attacks(board, depth - 1);
+
+            chessboard_undo_move(board);
+        }
+    }
+}
+
+void init_all(void)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+}
@@ -0,0 +1,153 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "fen.h"
+#include "uci.h"
+#include "book.h"
+
+#define BOOK_FILENAME "tests/bin/book.bin"
+
+typedef struct
+{
+    U64 key;
+    U16 move;
+    U16 weight;
+} TestEntry;
+
+/**
+ * Initializes all the lookup tables.
+ */
+void init_all(void);
+
+/**
+ * Writes the entries, sorted by key, as a Polyglot book.
+ */
+void write_book(TestEntry *entries, int num_entries);
+
+/**
+ * Tests the Polyglot keys against the examples of the Polyglot specification.
+ */
+Test(book, polyglot_keys, .init = init_all)
+{
+    struct
+    {
+        char *fen;
+        U64 key;
+    } positions[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9c},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823c9b50fd114196},
+        {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", 0x0756b94461c50fb0},
+        {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", 0x662fafb965db29d4},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", 0x652a607ca3f242c1},
+        {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9},
+        {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637},
+        {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560},
+    };
+
+    for (int i = 0; i < sizeof(positions) / sizeof(positions[0]); i++)
+    {
+        static ChessBoard board;
+        cr_assert_eq(fen_parse(&board, positions[i].fen, NULL), FEN_OK);
+        cr_assert_eq(book_key(&board), positions[i].key, "%s", positions[i].fen);
+    }
+}
+
+/**
+ * Tests probing a book, including castling moves and entries that are not
+ * legal on the board.
+ */
+Test(book, lookup, .init = init_all)
+{
+    static ChessBoard start, castling, other;
+    chessboard_init(&start, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    chessboard_init(&castling, "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+    chessboard_init(&other, "4k3/8/8/8/8/8/8/4K3 w - - 0 1");
+
+    U64 start_key = book_key(&start), castling_key = book_key(&castling);
+    TestEntry entries[] = {
+        {start_key, E2 | E4 << 6, 1},
+        {start_key, E4 | E2 << 6, 10},
+        {start_key, D4 | D2 << 6, 30},
+        {start_key, G1 | G8 << 6, 5},
+        {castling_key, H1 | E1 << 6, 2},
+        {castling_key, A1 | E1 << 6, 1},
+        {castling_key, E2 | E1 << 6, 0},
+        {start_key ^ 1, A3 | A2 << 6, 1},
+        {castling_key + 1, A3 | A2 << 6, 1},
+    };
+    write_book(entries, sizeof(entries) / sizeof(entries[0]));
+
+    Book *book = book_open(BOOK_FILENAME);
+    cr_assert_not_null(book);
+    cr_assert_eq(book->num_entries, 9);
+
+    BookMove moves[BOOK_MAX_MOVES];
+    char buffer[6];
+
+    cr_assert_eq(book_probe(book, &start, moves), 2);
+    uci_move_to_string(moves[0].move, buffer);
+    cr_assert_str_eq(buffer, "e2e4");
+    cr_assert_eq(moves[0].weight, 10);
+
+    uci_move_to_string(book_move(book, &start, BOOK_BEST, 0), buffer);
+    cr_assert_str_eq(buffer, "d2d4");
+
+    // Weighted selection follows the weights in book order
+    uci_move_to_string(book_move(book, &start, BOOK_WEIGHTED, 9), buffer);
+    cr_assert_str_eq(buffer, "e2e4");
+    uci_move_to_string(book_move(book, &start, BOOK_WEIGHTED, 10), buffer);
+    cr_assert_str_eq(buffer, "d2d4");
+
+    cr_assert_eq(book_probe(book, &castling, moves), 3);
+    cr_assert_eq(MoveType(moves[0].move), KING_CASTLE);
+    cr_assert_eq(MoveType(moves[1].move), QUEEN_CASTLE);
+    cr_assert_eq(moves[2].weight, 0);
+
+    cr_assert_eq(book_probe(book, &other, moves), 0);
+    cr_assert(IsNullMove(book_move(book, &other, BOOK_BEST, 0)));
+
+    book_close(book);
+    remove(BOOK_FILENAME);
+}
+
+void write_book(TestEntry *entries, int num_entries)
+{
+    // Insertion sort keeps entries with the same key in their given order
+    for (int i = 1; i < num_entries; i++)
+    {
+        TestEntry entry = entries[i];
+        int j = i;
+        for (; j > 0 && entries[j - 1].key > entry.key; j--)
+            entries[j] = entries[j - 1];
+        entries[j] = entry;
+    }
+
+    FILE *file_ptr = fopen(BOOK_FILENAME, "wb");
+    cr_assert_not_null(file_ptr);
+
+    for (int i = 0; i < num_entries; i++)
+    {
+        U8 bytes[16] = {0};
+        for (int j = 0; j < 8; j++)
+            bytes[j] = entries[i].key >> (56 - 8 * j);
+        bytes[8] = entries[i].move >> 8;
+        bytes[9] = entries[i].move;
+        bytes[10] = entries[i].weight >> 8;
+        bytes[11] = entries[i].weight;
+
+        fwrite(bytes, sizeof(bytes), 1, file_ptr);
+    }
+
+    fclose(file_ptr);
+}
+
+void init_all(void)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+}
@@ -4,8 +4,10 @@
 #include "magic_bitboard.h"
 #include "lookup_tables.h"
 #include "chessboard.h"
+#include "uci.h"
 
 #define TESTING_DEPTH 4
+#define KEY_TESTING_DEPTH 3
 
 typedef struct
 {
@@ -38,6 +40,29 @@ void init_all(void);
  */
 U64 count_moves(ChessBoard *board, int depth);
 
+/**
+ * Asserts that the key of every position reached within the given depth,
+ * updated incrementally by each move, matches the key hashed from scratch.
+ */
+void assert_keys(ChessBoard *board, int depth);
+
+/**
+ * Asserts that the legality found from the attacks of every position reached
+ * within the given depth matches making the move.
+ */
+void assert_legality(ChessBoard *board, int depth);
+
+/**
+ * Asserts that exactly the generated moves of the position are pseudo legal,
+ * out of every possible 16 bit move.
+ */
+void assert_pseudo_legality(ChessBoard *board);
+
+/**
+ * Plays the move written in coordinate notation, asserting that it is legal.
+ */
+void play(ChessBoard *board, char *move_str);
+
 /**
  * Tests move generation by checking that the correct number of moves is
  * generated for various positions up a depth of TEST_DEPTH.
@@ -63,6 +88,129 @@ ParameterizedTest(TestMoveParameters *test, chess_board, move_generation, .init
     }
 }
 
+/**
+ * Tests the incremental position keys against hashing every position.
+ */
+ParameterizedTestParameters(chess_board, incremental_keys)
+{
+    int num_tests;
+    TestMoveParameters *test_data = parse_move_data("tests/data/perftsuite.epd", &num_tests);
+
+    return cr_make_param_array(TestMoveParameters, test_data, num_tests, free_move_data);
+}
+
+ParameterizedTest(TestMoveParameters *test, chess_board, incremental_keys, .init = init_all)
+{
+    ChessBoard board;
+    chessboard_init(&board, test->fen_str);
+
+    assert_keys(&board, KEY_TESTING_DEPTH);
+}
+
+/**
+ * Tests the legality of moves found from the attacks on the king against
+ * playing the moves.
+ */
+ParameterizedTestParameters(chess_board, legality)
+{
+    int num_tests;
+    TestMoveParameters *test_data = parse_move_data("tests/data/perftsuite.epd", &num_tests);
+
+    return cr_make_param_array(TestMoveParameters, test_data, num_tests, free_move_data);
+}
+
+ParameterizedTest(TestMoveParameters *test, chess_board, legality, .init = init_all)
+{
+    ChessBoard board;
+    chessboard_init(&board, test->fen_str);
+
+    assert_legality(&board, KEY_TESTING_DEPTH);
+}
+
+/**
+ * Tests that the moves accepted without generating them are the generated ones,
+ * in the positions of the suite and the positions one move after them.
+ */
+ParameterizedTestParameters(chess_board, pseudo_legality)
+{
+    int num_tests;
+    TestMoveParameters *test_data = parse_move_data("tests/data/perftsuite.epd", &num_tests);
+
+    return cr_make_param_array(TestMoveParameters, test_data, num_tests, free_move_data);
+}
+
+ParameterizedTest(TestMoveParameters *test, chess_board, pseudo_legality, .init = init_all)
+{
+    ChessBoard board;
+    chessboard_init(&board, test->fen_str);
+
+    assert_pseudo_legality(&board);
+
+    MoveList list;
+    chessboard_generate_moves(&board, &list);
+    for (int i = 0; i < list.size; i++)
+    {
+        if (chessboard_make_move(&board, list.moves[i]))
+        {
+            assert_pseudo_legality(&board);
+
+            chessboard_undo_move(&board);
+        }
+    }
+}
+
+/**
+ * Tests that repetitions and the fifty move rule are detected, and that the
+ * move clocks are restored when moves are undone.
+ */
+Test(chess_board, draws, .init = init_all)
+{
+    static ChessBoard board;
+    char *moves[] = {"g1f3", "g8f6", "f3g1", "f6g8"};
+    char *black_first_moves[] = {"g8f6", "g1f3", "f6g8", "f3g1"};
+
+    chessboard_init(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    for (int i = 0; i < 4; i++)
+    {
+        cr_assert_not(chessboard_is_repetition(&board));
+        play(&board, moves[i]);
+    }
+    cr_assert(chessboard_is_repetition(&board));
+    cr_assert(chessboard_is_draw(&board));
+    cr_assert_eq(board.num_half_moves, 4);
+    cr_assert_eq(board.num_full_moves, 3);
+
+    // A pawn move starts a new window of positions that can repeat
+    play(&board, "e2e4");
+    cr_assert_eq(board.num_half_moves, 0);
+    for (int i = 0; i < 3; i++)
+    {
+        play(&board, black_first_moves[i]);
+        cr_assert_not(chessboard_is_repetition(&board));
+    }
+    play(&board, black_first_moves[3]);
+    cr_assert(chessboard_is_repetition(&board));
+    cr_assert_eq(board.num_half_moves, 4);
+
+    for (int i = 0; i < 5; i++)
+        chessboard_undo_move(&board);
+    cr_assert_eq(board.num_half_moves, 4);
+    cr_assert_eq(board.num_full_moves, 3);
+    cr_assert(chessboard_is_repetition(&board));
+
+    chessboard_init(&board, "4k3/8/8/8/8/8/4P3/R3K3 w - - 99 80");
+    cr_assert_not(chessboard_is_draw(&board));
+    play(&board, "a1a2");
+    cr_assert(chessboard_is_draw(&board));
+    chessboard_undo_move(&board);
+    play(&board, "e2e4");
+    cr_assert_not(chessboard_is_draw(&board));
+
+    // The null move a failed lookup returns is rejected instead of played
+    cr_assert_not(chessboard_make_move(&board, NULL_MOVE));
+    cr_assert_eq(board.position_key, chessboard_hash(&board));
+}
+
 TestMoveParameters *parse_move_data(char *filename, int *num_tests)
 {
     FILE *file_ptr = fopen(filename, "r");
@@ -150,6 +298,76 @@ U64 count_moves(ChessBoard *board, int depth)
     return total_moves;
 }
 
+void assert_keys(ChessBoard *board, int depth)
+{
+    if (depth == 0)
+        return;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+    for (int i = 0; i < list.size; i++)
+    {
+        U64 key = chessboard_key_after(board, list.moves[i]);
+
+        if (chessboard_make_move(board, list.moves[i]))
+        {
+            cr_assert_eq(board->position_key, chessboard_hash(board));
+            cr_assert_eq(board->position_key, key);
+            assert_keys(board, depth - 1);
+
+            chessboard_undo_move(board);
+        }
+    }
+}
+
+void assert_legality(ChessBoard *board, int depth)
+{
+    if (depth == 0)
+        return;
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+
+    int king = (board->current_color == WHITE) ? WHITE_KING : BLACK_KING;
+    bool in_check = chessboard_squared_attacked(board, bitboard_scan_forward(board->pieces[king]));
+    cr_assert_eq(list.attacks.checkers != 0, in_check);
+
+    for (int i = 0; i < list.size; i++)
+    {
+        bool legal = chessboard_is_legal(board, &list.attacks, list.moves[i]);
+
+        cr_assert_eq(chessboard_make_move(board, list.moves[i]), legal);
+        if (legal)
+        {
+            assert_legality(board, depth - 1);
+
+            chessboard_undo_move(board);
+        }
+    }
+}
+
+void assert_pseudo_legality(ChessBoard *board)
+{
+    static bool generated[1 << 16];
+    memset(generated, 0, sizeof(generated));
+
+    MoveList list;
+    chessboard_generate_moves(board, &list);
+    for (int i = 0; i < list.size; i++)
+        generated[list.moves[i]] = true;
+
+    for (int move = 0; move < (1 << 16); move++)
+        cr_assert_eq(chessboard_is_pseudo_legal(board, move), generated[move], "move %x", move);
+}
+
+void play(ChessBoard *board, char *move_str)
+{
+    Move move = uci_parse_move(board, move_str);
+
+    cr_assert_neq(move, NULL_MOVE, "move %s", move_str);
+    cr_assert(chessboard_make_move(board, move));
+}
+
 void init_all(void)
 {
     chessboard_init_keys();
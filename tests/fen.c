@@ -0,0 +1,136 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <string.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "fen.h"
+
+/**
+ * Initializes all the lookup tables used for move generation and
+ * board hasing.
+ */
+void init_all(void);
+
+/**
+ * Tests that writing a parsed FEN string gives back the same string for every
+ * position of the perft suite.
+ */
+Test(fen, round_trip, .init = init_all)
+{
+    FILE *file_ptr = fopen("tests/data/perftsuite.epd", "r");
+    cr_assert_not_null(file_ptr);
+
+    char line[1000];
+    while (fgets(line, sizeof(line), file_ptr) != NULL)
+    {
+        line[strcspn(line, ";\n")] = '\0';
+
+        ChessBoard board;
+        char fen[FEN_MAX_LENGTH];
+
+        cr_assert_eq(fen_parse(&board, line, NULL), FEN_OK);
+        cr_assert_eq(fen_write(&board, fen), strlen(line));
+        cr_assert_str_eq(fen, line);
+        cr_assert_eq(board.position_key, chessboard_hash(&board));
+    }
+
+    fclose(file_ptr);
+}
+
+/**
+ * Tests that each malformed field is reported.
+ */
+Test(fen, errors, .init = init_all)
+{
+    ChessBoard board;
+
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1", NULL), FEN_INVALID_PIECES);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", NULL), FEN_INVALID_PIECES);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/ppxppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", NULL), FEN_INVALID_PIECES);
+    cr_assert_eq(fen_parse(&board, "rnbqqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", NULL), FEN_INVALID_KINGS);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1", NULL), FEN_INVALID_COLOR);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkx - 0 1", NULL), FEN_INVALID_CASTLING);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e3 0 1", NULL), FEN_INVALID_EN_PASSENT);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0", NULL), FEN_INVALID_CLOCKS);
+    cr_assert_eq(fen_parse(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -", NULL), FEN_OK);
+    cr_assert_eq(board.num_full_moves, 1);
+
+    // A malformed string leaves the position parsed before it untouched
+    char before[FEN_MAX_LENGTH], after[FEN_MAX_LENGTH];
+    U64 key = board.position_key;
+    fen_write(&board, before);
+    cr_assert_eq(fen_parse(&board, "4k3/8/8/8/8/8/8/4K2R b K e6 0 1", NULL), FEN_INVALID_EN_PASSENT);
+    fen_write(&board, after);
+    cr_assert_str_eq(after, before);
+    cr_assert_eq(board.position_key, key);
+}
+
+/**
+ * Tests parsing the operations of EPD lines.
+ */
+Test(fen, epd_operations, .init = init_all)
+{
+    ChessBoard board;
+    EpdRecord record;
+
+    cr_assert_eq(epd_parse(&board, &record,
+        "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - bm Bb5 Bc4; id \"test;1\"; hmvc 2;\n"), FEN_OK);
+    cr_assert_str_eq(record.id, "test;1");
+    cr_assert_eq(record.num_best_moves, 2);
+    cr_assert_eq(MoveOrigin(record.best_moves[0]), F1);
+    cr_assert_eq(MoveTarget(record.best_moves[0]), B5);
+    cr_assert_eq(MoveTarget(record.best_moves[1]), C4);
+    cr_assert_eq(board.num_half_moves, 2);
+
+    // EPD has only the four position fields, the clocks being operations
+    char epd[FEN_MAX_LENGTH];
+    cr_assert_eq(epd_write(&board, epd), 60);
+    cr_assert_str_eq(epd, "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq -");
+
+    cr_assert_eq(epd_parse(&board, &record, "4k3/8/8/8/8/8/8/4K2R w K - 0 1;D1 15;D2 66;D6 764643"), FEN_OK);
+    cr_assert_eq(record.perft[1], 15);
+    cr_assert_eq(record.perft[2], 66);
+    cr_assert_eq(record.perft[3], 0);
+    cr_assert_eq(record.perft[6], 764643);
+
+    cr_assert_eq(epd_parse(&board, &record, "4k3/8/8/8/8/8/8/4K2R w K - bm Rh9;"), EPD_INVALID_MOVE);
+}
+
+/**
+ * Tests parsing castling, promotion, en passent and disambiguated SAN moves.
+ */
+Test(fen, san_moves, .init = init_all)
+{
+    ChessBoard board;
+    Move move;
+
+    fen_parse(&board, "r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1", NULL);
+
+    move = fen_parse_san(&board, "O-O+", 4);
+    cr_assert_eq(MoveType(move), KING_CASTLE);
+    move = fen_parse_san(&board, "O-O-O", 5);
+    cr_assert_eq(MoveType(move), QUEEN_CASTLE);
+    move = fen_parse_san(&board, "exd6", 4);
+    cr_assert_eq(MoveType(move), EN_PASSENT);
+    move = fen_parse_san(&board, "bxa8=N", 6);
+    cr_assert_eq(MoveType(move), KNIGHT_PROMOTION);
+    cr_assert_eq(MoveTarget(move), A8);
+    move = fen_parse_san(&board, "Rad1", 4);
+    cr_assert_eq(MoveOrigin(move), A1);
+
+    cr_assert(IsNullMove(fen_parse_san(&board, "Nf3", 3)));
+
+    // Both knights can reach d2
+    fen_parse(&board, "4k3/8/8/8/8/8/8/1N2KN2 w - - 0 1", NULL);
+    cr_assert(IsNullMove(fen_parse_san(&board, "Nd2", 3)));
+    move = fen_parse_san(&board, "Nbd2", 4);
+    cr_assert_eq(MoveOrigin(move), B1);
+}
+
+void init_all(void)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+}
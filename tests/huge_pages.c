@@ -0,0 +1,33 @@
+#include <criterion/criterion.h>
+#include <string.h>
+#include "huge_pages.h"
+
+/**
+ * Tests that memory is aligned to a huge page, zeroed and cleared completely
+ * whatever the number of threads and size.
+ */
+Test(huge_pages, aligned_and_cleared)
+{
+    U64 sizes[] = {1, 4096, HUGE_PAGE_SIZE, 5 * HUGE_PAGE_SIZE + 24};
+    int num_threads[] = {0, 1, 2, 3, 8};
+
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        U8 *memory = huge_pages_alloc(sizes[i]);
+        cr_assert_not_null(memory);
+        cr_assert_eq((U64) memory % HUGE_PAGE_SIZE, 0);
+        cr_assert_eq(memory[0], 0);
+        cr_assert_eq(memory[sizes[i] - 1], 0);
+
+        for (int j = 0; j < sizeof(num_threads) / sizeof(num_threads[0]); j++)
+        {
+            memset(memory, 0xff, sizes[i]);
+            huge_pages_clear(memory, sizes[i], num_threads[j]);
+
+            for (U64 k = 0; k < sizes[i]; k++)
+                cr_assert_eq(memory[k], 0, "size %llu, %i threads", (unsigned long long) sizes[i], num_threads[j]);
+        }
+
+        huge_pages_free(memory, sizes[i]);
+    }
+}
@@ -0,0 +1,164 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <string.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "fen.h"
+#include "packed_position.h"
+
+#define MAX_POSITIONS 256
+#define NUM_RECORDS (2 * PACKED_CHUNK_SIZE + 100)
+#define CONTAINER_FILENAME "tests/bin/packed_position.bin"
+
+static ChessBoard boards[MAX_POSITIONS];
+static int num_positions;
+
+/**
+ * Initializes all the lookup tables and loads the positions of the perft
+ * suite into boards.
+ */
+void init_all(void);
+
+/**
+ * Writes NUM_RECORDS positions into a container with the given flags and
+ * checks that sequential and random access reads return them.
+ */
+void check_container(U32 flags);
+
+/**
+ * Tests that decoding an encoded position restores the board and its key.
+ */
+Test(packed_position, round_trip, .init = init_all)
+{
+    cr_assert_eq(sizeof(PackedPosition), 32);
+
+    for (int i = 0; i < num_positions; i++)
+    {
+        static ChessBoard board;
+        PackedPosition packed;
+        char fen[FEN_MAX_LENGTH], decoded_fen[FEN_MAX_LENGTH];
+
+        packed_encode(&boards[i], &packed);
+        packed_decode(&packed, &board);
+
+        fen_write(&boards[i], fen);
+        fen_write(&board, decoded_fen);
+        cr_assert_str_eq(decoded_fen, fen);
+        cr_assert_eq(board.position_key, boards[i].position_key);
+    }
+
+    // Positions with more than 32 pieces do not fit
+    static ChessBoard board;
+    PackedPosition packed;
+    chessboard_init(&board, "rnbqkbnr/pppppppp/8/8/4N3/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    cr_assert_not(packed_encode(&board, &packed));
+}
+
+Test(packed_position, compressed_container, .init = init_all)
+{
+    check_container(PACKED_COMPRESSED);
+}
+
+Test(packed_position, raw_container, .init = init_all)
+{
+    check_container(0);
+}
+
+/**
+ * Tests that an empty container opens and that containers whose chunk size
+ * is zero or too large to allocate are rejected.
+ */
+Test(packed_position, container_header, .init = init_all)
+{
+    PackedWriter *writer = packed_writer_open(CONTAINER_FILENAME, sizeof(PackedPosition), 0);
+    cr_assert_not_null(writer);
+    cr_assert(packed_writer_close(writer));
+
+    PackedReader *reader = packed_reader_open(CONTAINER_FILENAME);
+    cr_assert_not_null(reader);
+    cr_assert_eq(reader->num_records, 0);
+    packed_reader_close(reader);
+
+    U32 chunk_sizes[] = {0, PACKED_MAX_CHUNK_SIZE + 1, 0xffffffff};
+    for (int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        // The chunk size follows the magic and the record size
+        FILE *file = fopen(CONTAINER_FILENAME, "r+b");
+        cr_assert_not_null(file);
+        fseek(file, 12, SEEK_SET);
+        fwrite(&chunk_sizes[i], sizeof(U32), 1, file);
+        fclose(file);
+
+        cr_assert_null(packed_reader_open(CONTAINER_FILENAME));
+    }
+
+    remove(CONTAINER_FILENAME);
+}
+
+void check_container(U32 flags)
+{
+    PackedWriter *writer = packed_writer_open(CONTAINER_FILENAME, sizeof(PackedPosition), flags);
+    cr_assert_not_null(writer);
+
+    PackedPosition packed, read;
+    for (int i = 0; i < NUM_RECORDS; i++)
+    {
+        packed_encode(&boards[i % num_positions], &packed);
+        cr_assert(packed_writer_add(writer, &packed));
+    }
+    cr_assert(packed_writer_close(writer));
+
+    PackedReader *reader = packed_reader_open(CONTAINER_FILENAME);
+    cr_assert_not_null(reader);
+    cr_assert_eq(reader->num_records, NUM_RECORDS);
+
+    for (int i = 0; i < NUM_RECORDS; i++)
+    {
+        cr_assert(packed_reader_next(reader, &read));
+        packed_encode(&boards[i % num_positions], &packed);
+        cr_assert(memcmp(&read, &packed, sizeof(PackedPosition)) == 0);
+    }
+    cr_assert_not(packed_reader_next(reader, &read));
+
+    // Jumps backwards and forwards across chunks
+    int indices[] = {NUM_RECORDS - 1, 0, PACKED_CHUNK_SIZE + 7, PACKED_CHUNK_SIZE - 1, 5000};
+    for (int i = 0; i < sizeof(indices) / sizeof(indices[0]); i++)
+    {
+        cr_assert(packed_reader_get(reader, indices[i], &read));
+        packed_encode(&boards[indices[i] % num_positions], &packed);
+        cr_assert(memcmp(&read, &packed, sizeof(PackedPosition)) == 0);
+    }
+
+    // Sequential reading continues after the record read last
+    cr_assert(packed_reader_next(reader, &read));
+    packed_encode(&boards[5001 % num_positions], &packed);
+    cr_assert(memcmp(&read, &packed, sizeof(PackedPosition)) == 0);
+
+    cr_assert_not(packed_reader_get(reader, NUM_RECORDS, &read));
+    packed_reader_close(reader);
+    remove(CONTAINER_FILENAME);
+}
+
+void init_all(void)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+
+    FILE *file_ptr = fopen("tests/data/perftsuite.epd", "r");
+    if (file_ptr == NULL)
+    {
+        printf("Could not open testing data.\n");
+        exit(1);
+    }
+
+    char line[1000];
+    for (num_positions = 0; num_positions < MAX_POSITIONS && fgets(line, sizeof(line), file_ptr) != NULL;)
+    {
+        if (fen_parse(&boards[num_positions], line, NULL) == FEN_OK)
+            num_positions++;
+    }
+
+    fclose(file_ptr);
+}
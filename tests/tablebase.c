@@ -0,0 +1,119 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include "magic_bitboard.h"
+#include "lookup_tables.h"
+#include "chessboard.h"
+#include "uci.h"
+#include "tablebase.h"
+
+#define TABLEBASE_DIRECTORY "tests/bin"
+
+/**
+ * Initializes all the lookup tables and generates the KQvK, KRvK and KPvK
+ * tables along with the tables they depend on.
+ */
+void init_all(void);
+
+/**
+ * Tests the results of positions whose distance to mate is known.
+ */
+Test(tablebase, known_results, .init = init_all)
+{
+    struct
+    {
+        char *fen;
+        TablebaseWdl wdl;
+        int plies;
+    } positions[] = {
+        {"7k/8/6K1/8/8/8/8/R7 w - - 0 1", TABLEBASE_WIN, 1},
+        {"R6k/8/6K1/8/8/8/8/8 b - - 0 1", TABLEBASE_LOSS, 0},
+        {"r7/8/8/8/8/6k1/8/7K b - - 0 1", TABLEBASE_WIN, 1},
+        {"7k/8/6Q1/8/8/8/8/6K1 b - - 0 1", TABLEBASE_DRAW, 0},
+        {"8/8/8/8/8/8/kR6/7K b - - 0 1", TABLEBASE_DRAW, 0},
+        {"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", TABLEBASE_LOSS, 24},
+        {"k7/8/K7/P7/8/8/8/8 w - - 0 1", TABLEBASE_DRAW, 0},
+    };
+
+    for (int i = 0; i < sizeof(positions) / sizeof(positions[0]); i++)
+    {
+        static ChessBoard board;
+        TablebaseWdl wdl, dtm_wdl;
+        int plies;
+
+        chessboard_init(&board, positions[i].fen);
+        cr_assert(tablebase_probe_wdl(&board, &wdl), "%s", positions[i].fen);
+        cr_assert(tablebase_probe_dtm(&board, &dtm_wdl, &plies), "%s", positions[i].fen);
+
+        cr_assert_eq(wdl, positions[i].wdl, "%s", positions[i].fen);
+        cr_assert_eq(dtm_wdl, positions[i].wdl, "%s", positions[i].fen);
+        cr_assert_eq(plies, positions[i].plies, "%s", positions[i].fen);
+    }
+
+    // Positions with more pieces or castling rights are not in a table
+    static ChessBoard board;
+    TablebaseWdl wdl;
+    chessboard_init(&board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    cr_assert_not(tablebase_probe_wdl(&board, &wdl));
+    chessboard_init(&board, "4k3/8/8/8/8/8/8/R3K3 w Q - 0 1");
+    cr_assert_not(tablebase_probe_wdl(&board, &wdl));
+
+    // Tables with pawns on both sides would miss en passent captures
+    cr_assert_not(tablebase_generate(TABLEBASE_DIRECTORY, "KPvKP", 1));
+    chessboard_init(&board, "4k3/4p3/8/8/8/8/4P3/4K3 w - - 0 1");
+    cr_assert_not(tablebase_probe_wdl(&board, &wdl));
+}
+
+/**
+ * Tests that the root move keeps the distance to mate.
+ */
+Test(tablebase, best_move, .init = init_all)
+{
+    static ChessBoard board;
+    Move move;
+    TablebaseWdl wdl;
+    char buffer[6];
+    int plies;
+
+    chessboard_init(&board, "7k/8/6K1/8/8/8/8/R7 w - - 0 1");
+    cr_assert(tablebase_root_move(&board, &move, &wdl, &plies));
+    uci_move_to_string(move, buffer);
+    cr_assert_str_eq(buffer, "a1a8");
+    cr_assert_eq(wdl, TABLEBASE_WIN);
+    cr_assert_eq(plies, 1);
+
+    // Every move played from the table shortens the mate by one ply
+    chessboard_init(&board, "8/8/8/4k3/8/8/8/R3K3 w - - 0 1");
+    TablebaseWdl dtm_wdl;
+    int dtm_plies;
+    cr_assert(tablebase_probe_dtm(&board, &dtm_wdl, &dtm_plies));
+    cr_assert_eq(dtm_wdl, TABLEBASE_WIN);
+
+    for (int expected = dtm_plies; expected > 0; expected--)
+    {
+        cr_assert(tablebase_root_move(&board, &move, &wdl, &plies));
+        cr_assert_eq(plies, expected);
+        cr_assert_eq(wdl, (expected % 2) ? TABLEBASE_WIN : TABLEBASE_LOSS);
+        cr_assert(chessboard_make_move(&board, move));
+    }
+
+    cr_assert(tablebase_probe_dtm(&board, &dtm_wdl, &dtm_plies));
+    cr_assert_eq(dtm_wdl, TABLEBASE_LOSS);
+    cr_assert_eq(dtm_plies, 0);
+}
+
+void init_all(void)
+{
+    chessboard_init_keys();
+    magic_bitboards_init();
+    lookup_tables_init();
+
+    // Reuses the tables left by an earlier test
+    tablebase_init(TABLEBASE_DIRECTORY);
+    if (!tablebase_generate(TABLEBASE_DIRECTORY, "KQvK", 2)
+        || !tablebase_generate(TABLEBASE_DIRECTORY, "KRvK", 2)
+        || !tablebase_generate(TABLEBASE_DIRECTORY, "KPvK", 2))
+    {
+        printf("Could not generate the tables.\n");
+        exit(1);
+    }
+}
@@ -0,0 +1,178 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include "chessboard.h"
+#include "transposition_table.h"
+
+#define TABLE_FILENAME "tests/bin/table.bin"
+#define TABLE_SIZE 4096
+
+/**
+ * Initializes the position keys.
+ */
+void init_keys(void);
+
+/**
+ * Stores a move, score and depth derived from every key in [0, num_keys).
+ */
+void fill_table(TranspositionTable *table, int num_keys);
+
+/**
+ * Asserts that the table holds the entries stored by fill_table.
+ */
+void assert_filled(TranspositionTable *table, int num_keys);
+
+/**
+ * Tests that a saved table is loaded back with the same entries.
+ */
+Test(transposition_table, save_and_load, .init = init_keys)
+{
+    TranspositionTable *table = table_init(TABLE_SIZE);
+    fill_table(table, 1000);
+    table_new_search(table);
+    cr_assert(table_save(table, TABLE_FILENAME));
+    table_free(table);
+
+    table = table_load(TABLE_FILENAME);
+    cr_assert_not_null(table);
+    cr_assert_eq(table->size, TABLE_SIZE);
+    cr_assert_eq(table->age, 1);
+    assert_filled(table, 1000);
+    table_free(table);
+
+    remove(TABLE_FILENAME);
+}
+
+/**
+ * Tests that a mapped table keeps its entries after being unmapped.
+ */
+Test(transposition_table, mapped_file, .init = init_keys)
+{
+    remove(TABLE_FILENAME);
+
+    TranspositionTable *table = table_map(TABLE_FILENAME, TABLE_SIZE);
+    cr_assert_not_null(table);
+    cr_assert_eq(table->size, TABLE_SIZE);
+    fill_table(table, 1000);
+    table_free(table);
+
+    // The size of an existing file takes precedence over the given size
+    table = table_map(TABLE_FILENAME, 1);
+    cr_assert_not_null(table);
+    cr_assert_eq(table->size, TABLE_SIZE);
+    assert_filled(table, 1000);
+    table_free(table);
+
+    table = table_load(TABLE_FILENAME);
+    cr_assert_not_null(table);
+    assert_filled(table, 1000);
+    table_free(table);
+
+    // Saving a mapped table to its own file flushes it instead of truncating it
+    table = table_map(TABLE_FILENAME, 1);
+    cr_assert_not_null(table);
+    table_new_search(table);
+    cr_assert(table_save(table, TABLE_FILENAME));
+    assert_filled(table, 1000);
+    table_free(table);
+
+    table = table_load(TABLE_FILENAME);
+    cr_assert_not_null(table);
+    cr_assert_eq(table->age, 1);
+    assert_filled(table, 1000);
+    table_free(table);
+
+    remove(TABLE_FILENAME);
+}
+
+/**
+ * Tests that positions sharing a slot are told apart by the upper bits of
+ * their keys.
+ */
+Test(transposition_table, shared_slot, .init = init_keys)
+{
+    TranspositionTable *table = table_init(TABLE_SIZE);
+    fill_table(table, 1000);
+
+    // Keys differing only above the bits of the slot index land on the same slot
+    EntryData data;
+    U64 other_key = 10 + (1ULL << 48);
+    cr_assert_eq(other_key % TABLE_SIZE, 10);
+    cr_assert_not(table_probe(table, other_key, &data));
+
+    table_store(table, other_key, NULL_MOVE, 1, 40, BOUND_EXACT);
+    cr_assert(table_probe(table, other_key, &data));
+    cr_assert_eq(data.depth, 40);
+    cr_assert_not(table_probe(table, 10, &data));
+
+    table_free(table);
+}
+
+/**
+ * Tests that files written with another entry layout or other keys, and files
+ * that are not tables, are rejected.
+ */
+Test(transposition_table, incompatible_files, .init = init_keys)
+{
+    TranspositionTable *table = table_init(TABLE_SIZE);
+    cr_assert(table_save(table, TABLE_FILENAME));
+    table_free(table);
+
+    // Changes the version
+    FILE *file_ptr = fopen(TABLE_FILENAME, "r+b");
+    fseek(file_ptr, 8, SEEK_SET);
+    fputc(TABLE_FILE_VERSION + 1, file_ptr);
+    fclose(file_ptr);
+
+    cr_assert_null(table_load(TABLE_FILENAME));
+    cr_assert_null(table_map(TABLE_FILENAME, TABLE_SIZE));
+
+    // Changes the keys
+    table = table_init(TABLE_SIZE);
+    cr_assert(table_save(table, TABLE_FILENAME));
+    table_free(table);
+
+    SIDE_KEY[WHITE] ^= 1;
+    cr_assert_null(table_load(TABLE_FILENAME));
+    SIDE_KEY[WHITE] ^= 1;
+    table = table_load(TABLE_FILENAME);
+    cr_assert_not_null(table);
+    table_free(table);
+
+    // Truncates the file
+    file_ptr = fopen(TABLE_FILENAME, "wb");
+    fputs("CETTABLE", file_ptr);
+    fclose(file_ptr);
+
+    cr_assert_null(table_load(TABLE_FILENAME));
+    cr_assert_null(table_map(TABLE_FILENAME, TABLE_SIZE));
+
+    remove(TABLE_FILENAME);
+}
+
+void fill_table(TranspositionTable *table, int num_keys)
+{
+    for (int key = 0; key < num_keys; key++)
+    {
+        Move move = CreateMove(key % 64, (key + 1) % 64, NORMAL_MOVE);
+        table_store(table, key, move, key - 500, key % 32, BOUND_EXACT);
+    }
+}
+
+void assert_filled(TranspositionTable *table, int num_keys)
+{
+    for (int key = 0; key < num_keys; key++)
+    {
+        EntryData data;
+        cr_assert(table_probe(table, key, &data));
+        cr_assert_eq(MoveOrigin(data.move), key % 64);
+        cr_assert_eq(MoveTarget(data.move), (key + 1) % 64);
+        cr_assert_eq(data.score, key - 500);
+        cr_assert_eq(data.depth, key % 32);
+        cr_assert_eq(data.bound, BOUND_EXACT);
+    }
+}
+
+void init_keys(void)
+{
+    chessboard_init_keys();
+}